@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include <dxbc/dxbc_enums.h>
+
+namespace dxvk {
+
+  /**
+   * \brief Encodes an opcode token
+   *
+   * \param [in] op Opcode
+   * \param [in] length Instruction length, in dwords,
+   *    including the opcode token itself
+   * \returns Opcode token
+   */
+  inline uint32_t opcodeToken(DxbcOpcode op, uint32_t length) {
+    return uint32_t(op) | (length << 24);
+  }
+
+  /**
+   * \brief Encodes a four-component operand token
+   *
+   * \param [in] mode Component selection mode
+   * \param [in] select Component mask, swizzle or
+   *    component index, depending on the mode
+   * \param [in] type Operand type
+   * \param [in] dim Index dimension
+   * \returns Operand token
+   */
+  inline uint32_t operandToken(uint32_t mode, uint32_t select, DxbcOperandType type, uint32_t dim) {
+    return 2u | (mode << 2) | (select << 4) | (uint32_t(type) << 12) | (dim << 20);
+  }
+
+}
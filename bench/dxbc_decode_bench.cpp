@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <dxbc/dxbc_decoder.h>
+
+#include <util_arena.h>
+
+#include "bench_dxbc.h"
+
+using namespace dxvk;
+
+namespace {
+
+  using Clock = std::chrono::high_resolution_clock;
+
+  /**
+   * \brief Generates shader code
+   *
+   * Emits a mix of ALU instructions with register,
+   * immediate and relatively indexed operands, which
+   * is roughly representative of real shaders.
+   * \param [in] count Number of instruction groups
+   * \returns Code words
+   */
+  std::vector<uint32_t> generateCode(uint32_t count) {
+    std::vector<uint32_t> code;
+
+    for (uint32_t i = 0; i < count; i++) {
+      // mad r0, r0, l(a, b, c, d), v0
+      code.push_back(opcodeToken(DxbcOpcode::Mad, 12));
+      code.push_back(operandToken(0, 0xf,  DxbcOperandType::Temp, 1));
+      code.push_back(0);
+      code.push_back(operandToken(1, 0xe4, DxbcOperandType::Temp, 1));
+      code.push_back(0);
+      code.push_back(operandToken(0, 0,    DxbcOperandType::Imm32, 0));
+
+      for (uint32_t c = 0; c < 4; c++) {
+        float f = float(4 * i + c);
+        uint32_t dw;
+        std::memcpy(&dw, &f, sizeof(dw));
+        code.push_back(dw);
+      }
+
+      code.push_back(operandToken(1, 0xe4, DxbcOperandType::Input, 1));
+      code.push_back(0);
+
+      // add r1, r0, x0[r0.x + 1]
+      code.push_back(opcodeToken(DxbcOpcode::Add, 10));
+      code.push_back(operandToken(0, 0xf,  DxbcOperandType::Temp, 1));
+      code.push_back(1);
+      code.push_back(operandToken(1, 0xe4, DxbcOperandType::Temp, 1));
+      code.push_back(0);
+      code.push_back(operandToken(1, 0xe4, DxbcOperandType::IndexableTemp, 2) | (2u << 25));
+      code.push_back(0);
+      code.push_back(1);
+      code.push_back(operandToken(2, 0,    DxbcOperandType::Temp, 1));
+      code.push_back(0);
+    }
+
+    code.push_back(opcodeToken(DxbcOpcode::Ret, 1));
+    return code;
+  }
+
+
+  /**
+   * \brief Measures throughput
+   *
+   * Runs the function the given number of times inside
+   * an arena scope, the way the driver translates shaders.
+   * \returns Throughput in MB/s of SHEX, based on the best run
+   */
+  template<typename Proc>
+  double measure(Arena& arena, size_t bytes, uint32_t iterations, const Proc& proc) {
+    double best = 0.0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+      auto t0 = Clock::now();
+
+      { ArenaScope scope(arena);
+        proc();
+      }
+
+      double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+      best = std::max(best, double(bytes) / sec / 1.0e6);
+    }
+
+    return best;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t iterations = argc > 1 ? std::atoi(argv[1]) : 16;
+
+  // The first two columns compare raw decode speed. The last two
+  // compare what compiling a module costs: decoding the code for
+  // both the analyzer and the compiler pass, versus building the
+  // program once and iterating over it twice. Past a few MiB of
+  // code, the decoded operands no longer fit in the cache and the
+  // program loses its advantage; real shaders stay well below that.
+  std::printf("%10s %12s %12s %12s %12s %12s\n", "instrs", "SHEX (KiB)",
+    "decode MB/s", "build MB/s", "2x decode", "build + 2x");
+
+  Arena arena;
+  volatile uint32_t sink = 0;
+
+  for (uint32_t count = 64; count <= 65536; count *= 4) {
+    std::vector<uint32_t> code = generateCode(count);
+    DxbcCodeSlice slice(code.data(), code.data() + code.size());
+
+    size_t bytes = code.size() * sizeof(uint32_t);
+    size_t instructions = 0;
+
+    auto decode = [&] {
+      DxbcDecodeContext decoder;
+      DxbcCodeSlice s = slice;
+
+      while (!s.atEnd()) {
+        decoder.decodeInstruction(s);
+        sink = sink + decoder.getInstruction().dstCount;
+      }
+    };
+
+    auto iterate = [&] (const DxbcDecodedProgram& program) {
+      for (const auto& ins : program)
+        sink = sink + ins.dstCount;
+    };
+
+    double decodeRate = measure(arena, bytes, iterations, decode);
+
+    double buildRate = measure(arena, bytes, iterations, [&] {
+      DxbcDecodedProgram program(slice);
+      instructions = program.size();
+    });
+
+    double twiceRate = measure(arena, bytes, iterations, [&] {
+      decode();
+      decode();
+    });
+
+    double programRate = measure(arena, bytes, iterations, [&] {
+      DxbcDecodedProgram program(slice);
+      iterate(program);
+      iterate(program);
+    });
+
+    std::printf("%10zu %12.1f %12.1f %12.1f %12.1f %12.1f\n", instructions,
+      double(bytes) / 1024.0, decodeRate, buildRate, twiceRate, programRate);
+  }
+
+  return 0;
+}
@@ -0,0 +1,544 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <driver.h>
+
+#include "bench_dxbc.h"
+
+using namespace dxvk;
+
+namespace {
+
+  struct Stage {
+    const char*                             name;
+    unsigned long long decompile_stats::*   counter;
+  };
+
+  const std::array<Stage, 6> Stages = {{
+    { "parse",        &decompile_stats::parse_ns        },
+    { "analysis",     &decompile_stats::analysis_ns     },
+    { "compile",      &decompile_stats::compile_ns      },
+    { "spirv-parse",  &decompile_stats::spirv_parse_ns  },
+    { "emit",         &decompile_stats::emit_ns         },
+    { "total",        &decompile_stats::total_ns        },
+  }};
+
+
+  struct Shader {
+    std::string           name;
+    std::vector<uint32_t> blob;
+  };
+
+
+  uint32_t floatBits(float f) {
+    uint32_t dw;
+    std::memcpy(&dw, &f, sizeof(dw));
+    return dw;
+  }
+
+
+  /**
+   * \brief Generates a pixel shader program
+   *
+   * Emits a chain of ALU instructions, optionally mixed
+   * with relatively indexed temporaries or with nested
+   * if/else blocks and switch statements.
+   * \param [in] count Number of ALU instructions
+   * \param [in] relative Whether to use indexable temps
+   * \param [in] controlFlow Whether to emit branches
+   * \returns SHEX chunk code, including the version token
+   */
+  std::vector<uint32_t> generateProgram(uint32_t count, bool relative, bool controlFlow) {
+    std::vector<uint32_t> code = { 0x50u, 0u };
+
+    auto emit = [&code] (std::initializer_list<uint32_t> tokens) {
+      code.insert(code.end(), tokens.begin(), tokens.end());
+    };
+
+    // dcl_input_ps linear v0.xyzw, dcl_output o0.xyzw, dcl_temps 2
+    emit({ opcodeToken(DxbcOpcode::DclInputPs, 3) | (2u << 11), operandToken(0, 0xf, DxbcOperandType::Input, 1), 0 });
+    emit({ opcodeToken(DxbcOpcode::DclOutput, 3), operandToken(0, 0xf, DxbcOperandType::Output, 1), 0 });
+    emit({ opcodeToken(DxbcOpcode::DclTemps, 2), 2 });
+
+    if (relative)
+      emit({ opcodeToken(DxbcOpcode::DclIndexableTemp, 4), 0, 8, 4 });
+
+    // mov r0, v0
+    emit({ opcodeToken(DxbcOpcode::Mov, 5),
+      operandToken(0, 0xf,  DxbcOperandType::Temp,  1), 0,
+      operandToken(1, 0xe4, DxbcOperandType::Input, 1), 0 });
+
+    uint32_t depth = 0;
+    std::array<bool, 4> hasElse = { };
+
+    for (uint32_t i = 0; i < count; i++) {
+      if (controlFlow) {
+        if (i % 7 == 6) {
+          // switch r0.x { case i: mov r0, r1; break; default: break; }
+          emit({ opcodeToken(DxbcOpcode::Switch, 3), operandToken(2, 0, DxbcOperandType::Temp, 1), 0 });
+          emit({ opcodeToken(DxbcOpcode::Case, 3), 1u | (uint32_t(DxbcOperandType::Imm32) << 12), i });
+          emit({ opcodeToken(DxbcOpcode::Mov, 5),
+            operandToken(0, 0xf,  DxbcOperandType::Temp, 1), 0,
+            operandToken(1, 0xe4, DxbcOperandType::Temp, 1), 1 });
+          emit({ opcodeToken(DxbcOpcode::Break, 1) });
+          emit({ opcodeToken(DxbcOpcode::Default, 1) });
+          emit({ opcodeToken(DxbcOpcode::Break, 1) });
+          emit({ opcodeToken(DxbcOpcode::EndSwitch, 1) });
+        } else if (i % 5 <= 1 && depth < 3) {
+          // if_nz r0.x
+          emit({ opcodeToken(DxbcOpcode::If, 3) | (1u << 18), operandToken(2, 0, DxbcOperandType::Temp, 1), 0 });
+          hasElse[++depth] = false;
+        } else if (i % 5 == 2 && depth && !hasElse[depth]) {
+          emit({ opcodeToken(DxbcOpcode::Else, 1) });
+          hasElse[depth] = true;
+        } else if (depth) {
+          emit({ opcodeToken(DxbcOpcode::EndIf, 1) });
+          depth -= 1;
+        }
+      }
+
+      if (relative && i % 4 == 3) {
+        // mov x0[r0.x + 1], r1; mov r1, x0[r0.y + 2]
+        emit({ opcodeToken(DxbcOpcode::Mov, 8),
+          operandToken(0, 0xf, DxbcOperandType::IndexableTemp, 2) | (2u << 25), 0, 1,
+          operandToken(2, 0, DxbcOperandType::Temp, 1), 0,
+          operandToken(1, 0xe4, DxbcOperandType::Temp, 1), 1 });
+        emit({ opcodeToken(DxbcOpcode::Mov, 8),
+          operandToken(0, 0xf, DxbcOperandType::Temp, 1), 1,
+          operandToken(1, 0xe4, DxbcOperandType::IndexableTemp, 2) | (2u << 25), 0, 2,
+          operandToken(2, 1, DxbcOperandType::Temp, 1), 0 });
+      }
+
+      // mad r0, r0, l(a, b, c, d), v0
+      emit({ opcodeToken(DxbcOpcode::Mad, 12),
+        operandToken(0, 0xf,  DxbcOperandType::Temp,  1), 0,
+        operandToken(1, 0xe4, DxbcOperandType::Temp,  1), 0,
+        operandToken(0, 0,    DxbcOperandType::Imm32, 0),
+        floatBits(float(4 * i + 1)), floatBits(float(4 * i + 2)),
+        floatBits(float(4 * i + 3)), floatBits(float(4 * i + 4)),
+        operandToken(1, 0xe4, DxbcOperandType::Input, 1), 0 });
+    }
+
+    while (depth--)
+      emit({ opcodeToken(DxbcOpcode::EndIf, 1) });
+
+    // mov o0, r0; ret
+    emit({ opcodeToken(DxbcOpcode::Mov, 5),
+      operandToken(0, 0xf,  DxbcOperandType::Output, 1), 0,
+      operandToken(1, 0xe4, DxbcOperandType::Temp,   1), 0 });
+    emit({ opcodeToken(DxbcOpcode::Ret, 1) });
+
+    code[1] = code.size();
+    return code;
+  }
+
+
+  /**
+   * \brief Generates a signature chunk with one element
+   *
+   * \param [in] name Semantic name
+   * \param [in] systemValue System value type
+   * \returns Chunk data
+   */
+  std::vector<uint32_t> generateSignature(const char* name, uint32_t systemValue) {
+    std::vector<uint32_t> chunk = { 1, 8, 32, 0, systemValue, 3, 0, 0xf | (0xf << 8) };
+
+    std::vector<uint32_t> str((std::strlen(name) + 4) / 4);
+    std::memcpy(str.data(), name, std::strlen(name));
+    chunk.insert(chunk.end(), str.begin(), str.end());
+    return chunk;
+  }
+
+
+  /**
+   * \brief Generates a DXBC container
+   *
+   * The checksum is left at zero, which is what
+   * unsigned blobs produced by tools look like.
+   * \param [in] program SHEX chunk code
+   * \returns DXBC blob
+   */
+  std::vector<uint32_t> generateBlob(const std::vector<uint32_t>& program) {
+    const std::array<std::pair<const char*, std::vector<uint32_t>>, 3> chunks = {{
+      { "ISGN", generateSignature("TEXCOORD",  0) },
+      { "OSGN", generateSignature("SV_Target", 64) },
+      { "SHEX", program },
+    }};
+
+    std::vector<uint32_t> blob(8 + chunks.size());
+    std::memcpy(blob.data(), "DXBC", 4);
+    blob[5] = 1;
+    blob[7] = chunks.size();
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      uint32_t tag;
+      std::memcpy(&tag, chunks[i].first, 4);
+
+      blob[8 + i] = blob.size() * sizeof(uint32_t);
+      blob.push_back(tag);
+      blob.push_back(chunks[i].second.size() * sizeof(uint32_t));
+      blob.insert(blob.end(), chunks[i].second.begin(), chunks[i].second.end());
+    }
+
+    blob[6] = blob.size() * sizeof(uint32_t);
+    return blob;
+  }
+
+
+  std::vector<Shader> generateCorpus() {
+    std::vector<Shader> corpus;
+
+    for (uint32_t count : { 8u, 64u, 512u }) {
+      corpus.push_back({ "alu-"  + std::to_string(count), generateBlob(generateProgram(count, false, false)) });
+      corpus.push_back({ "rel-"  + std::to_string(count), generateBlob(generateProgram(count, true,  false)) });
+      corpus.push_back({ "cf-"   + std::to_string(count), generateBlob(generateProgram(count, false, true )) });
+    }
+
+    return corpus;
+  }
+
+
+  const char* targetName(decompile_target target) {
+    return target == DECOMPILE_TARGET_GLSL ? "glsl" : "hlsl";
+  }
+
+
+  /**
+   * \brief Describes the build of this binary
+   *
+   * The compiler and optimization mode alone can move stage
+   * latencies by more than the gate allows, so baselines are
+   * only compared against the build they were recorded with.
+   * \returns Compiler and optimization mode
+   */
+  std::string buildName() {
+#if defined(__clang__)
+    std::string name = "clang-" + std::to_string(__clang_major__) + "." + std::to_string(__clang_minor__);
+#elif defined(__GNUC__)
+    std::string name = "gcc-" + std::to_string(__GNUC__) + "." + std::to_string(__GNUC_MINOR__);
+#elif defined(_MSC_VER)
+    std::string name = "msvc-" + std::to_string(_MSC_VER);
+#else
+    std::string name = "unknown";
+#endif
+
+#if defined(BENCH_OPTIMIZE)
+    name += "-" BENCH_OPTIMIZE;
+#elif defined(__OPTIMIZE__)
+    name += "-optimized";
+#else
+    name += "-unoptimized";
+#endif
+
+    return name;
+  }
+
+
+  /**
+   * \brief Runs a fixed reference workload
+   *
+   * Sorts and hashes a fixed set of numbers. Scaling the
+   * baseline by the ratio of this workload's times roughly
+   * accounts for a machine with a different clock speed.
+   * It does not account for load from other processes,
+   * which slows the stages down by different amounts than
+   * this workload, so the gate needs an idle machine.
+   * \returns Time taken, in nanoseconds
+   */
+  unsigned long long calibrate() {
+    using Clock = std::chrono::high_resolution_clock;
+
+    auto t0 = Clock::now();
+
+    std::vector<uint32_t> values(16384);
+    uint32_t x = 1;
+
+    for (auto& v : values)
+      v = (x = x * 1664525u + 1013904223u);
+
+    std::sort(values.begin(), values.end());
+
+    std::unordered_map<uint32_t, uint32_t> map;
+
+    for (uint32_t i = 0; i < values.size(); i++)
+      map.emplace(values[i], i);
+
+    if (map.size() != values.size())
+      std::abort();
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+  }
+
+
+  double percentile(std::vector<unsigned long long>& samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    size_t index = size_t(p * double(samples.size() - 1) / 100.0 + 0.5);
+    return double(samples[index]);
+  }
+
+
+  void usage() {
+    std::fprintf(stderr,
+      "pipeline_bench [options]\n"
+      "\n"
+      "Options:\n"
+      "  -n count    - Iterations per shader and target [Default: 20]\n"
+      "  -w file     - Write fastest stage latencies per shader to file\n"
+      "  -b file     - Compare fastest stage latencies per shader against file\n"
+      "  -t percent  - Allowed slowdown against the baseline [Default: 25]\n");
+    std::exit(1);
+  }
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t    iterations   = 20;
+  double      threshold    = 25.0;
+  const char* writePath    = nullptr;
+  const char* baselinePath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 == argc)
+      usage();
+
+    if (!std::strcmp(argv[i], "-n"))
+      iterations = std::max(std::atoi(argv[++i]), 1);
+    else if (!std::strcmp(argv[i], "-t"))
+      threshold = std::atof(argv[++i]);
+    else if (!std::strcmp(argv[i], "-w"))
+      writePath = argv[++i];
+    else if (!std::strcmp(argv[i], "-b"))
+      baselinePath = argv[++i];
+    else
+      usage();
+  }
+
+  const std::array<decompile_target, 2> targets = { DECOMPILE_TARGET_GLSL, DECOMPILE_TARGET_HLSL };
+
+  std::vector<Shader> corpus = generateCorpus();
+
+  // Percentiles over the whole corpus describe the workload, but
+  // they mix shaders of very different sizes. The regression gate
+  // uses the fastest run of each shader, target and stage instead,
+  // since noise on a busy machine only ever makes runs slower.
+  std::array<std::vector<unsigned long long>, Stages.size()> samples;
+  std::vector<std::array<unsigned long long, Stages.size()>> fastest(targets.size() * corpus.size());
+
+  for (auto& entry : fastest)
+    entry.fill(~0ull);
+
+  unsigned long long dxbcBytes    = 0;
+  unsigned long long dxbcIns      = 0;
+  unsigned long long spirvBytes   = 0;
+  unsigned long long spirvIns     = 0;
+  unsigned long long arenaBytes   = 0;
+  unsigned long long calibration  = ~0ull;
+  uint32_t failures = 0;
+
+  for (size_t t = 0; t < targets.size(); t++) {
+    // The first pass warms up the per-thread arena
+    for (uint32_t i = 0; i <= iterations; i++) {
+      // Interleave calibration runs with the corpus, so
+      // that both see the same machine conditions
+      calibration = std::min(calibration, calibrate());
+
+      for (size_t c = 0; c < corpus.size(); c++) {
+        const Shader& shader = corpus[c];
+
+        decompile_stats stats;
+        decompile_result result = decompile_with_stats(targets[t],
+          reinterpret_cast<const char*>(shader.blob.data()),
+          shader.blob.size() * sizeof(uint32_t), &stats);
+
+        free_compiled_string(result.output);
+
+        if (result.status != DECOMPILE_SUCCESS) {
+          if (!i)
+            std::fprintf(stderr, "%s: %s\n", shader.name.c_str(), decompile_status_string(result.status));
+          failures += 1;
+          continue;
+        }
+
+        if (!i)
+          continue;
+
+        auto& best = fastest[t * corpus.size() + c];
+
+        for (size_t s = 0; s < Stages.size(); s++) {
+          samples[s].push_back(stats.*Stages[s].counter);
+          best[s] = std::min(best[s], stats.*Stages[s].counter);
+        }
+
+        dxbcBytes  += shader.blob.size() * sizeof(uint32_t);
+        dxbcIns    += stats.dxbc_instructions;
+        spirvBytes += stats.spirv_size;
+        spirvIns   += stats.spirv_instructions;
+        arenaBytes  = std::max(arenaBytes, stats.arena_bytes_allocated);
+      }
+    }
+  }
+
+  if (failures) {
+    std::fprintf(stderr, "%u translations failed\n", failures);
+    return 1;
+  }
+
+  std::printf("%zu shaders, %u iterations, GLSL and HLSL\n", corpus.size(), iterations);
+  std::printf("%llu DXBC instructions, %llu SPIR-V instructions (%.1f KiB) per pass, up to %.1f KiB arena per shader\n\n",
+    dxbcIns / (2 * iterations), spirvIns / (2 * iterations),
+    double(spirvBytes) / double(2 * iterations) / 1024.0, double(arenaBytes) / 1024.0);
+
+  std::printf("%12s %12s %12s %12s %14s %12s\n",
+    "stage", "p50 (us)", "p90 (us)", "p99 (us)", "shaders/s", "MB/s");
+
+  for (size_t s = 0; s < Stages.size(); s++) {
+    unsigned long long sum = 0;
+
+    for (auto ns : samples[s])
+      sum += ns;
+
+    double seconds = double(sum) / 1.0e9;
+
+    std::printf("%12s %12.2f %12.2f %12.2f %14.0f %12.1f\n", Stages[s].name,
+      percentile(samples[s], 50.0) / 1.0e3,
+      percentile(samples[s], 90.0) / 1.0e3,
+      percentile(samples[s], 99.0) / 1.0e3,
+      double(samples[s].size()) / seconds,
+      double(dxbcBytes) / seconds / 1.0e6);
+  }
+
+  if (writePath) {
+    FILE* file = std::fopen(writePath, "w");
+
+    if (!file) {
+      std::fprintf(stderr, "%s: Failed to open file\n", writePath);
+      return 1;
+    }
+
+    std::fprintf(file, "# Fastest run of %u, recorded on an idle machine by the build below.\n", iterations);
+    std::fprintf(file, "# Regenerate with: zig build bench-baseline -Doptimize=ReleaseFast\n");
+    std::fprintf(file, "# target shader stage nanoseconds\n");
+    std::fprintf(file, "build %s\n", buildName().c_str());
+    std::fprintf(file, "calibration %llu\n", calibration);
+
+    for (size_t t = 0; t < targets.size(); t++) {
+      for (size_t c = 0; c < corpus.size(); c++) {
+        for (size_t s = 0; s < Stages.size(); s++) {
+          std::fprintf(file, "%s %s %s %llu\n", targetName(targets[t]),
+            corpus[c].name.c_str(), Stages[s].name, fastest[t * corpus.size() + c][s]);
+        }
+      }
+    }
+
+    std::fclose(file);
+  }
+
+  if (baselinePath) {
+    FILE* file = std::fopen(baselinePath, "r");
+
+    if (!file) {
+      std::fprintf(stderr, "%s: Failed to open file\n", baselinePath);
+      return 1;
+    }
+
+    // Fastest runs of stages below 100us still spread by up to a
+    // third, or about 10us, between runs on an idle machine, so
+    // small absolute changes never count.
+    constexpr double MinChangeNs = 20000.0;
+
+    char line[256];
+    char target[16];
+    char name[64];
+    char stage[64];
+    double baseline;
+
+    // The build and calibration time apply to all entries, so read them first
+    std::string build;
+    double scale = 1.0;
+
+    while (std::fgets(line, sizeof(line), file)) {
+      if (std::sscanf(line, "build %63s", name) == 1)
+        build = name;
+      else if (std::sscanf(line, "calibration %lf", &baseline) == 1 && baseline > 0.0)
+        scale = double(calibration) / baseline;
+    }
+
+    if (build != buildName()) {
+      std::fprintf(stderr, "%s: Recorded by a %s build, this is a %s build\n",
+        baselinePath, build.empty() ? "different" : build.c_str(), buildName().c_str());
+      std::fclose(file);
+      return 1;
+    }
+
+    std::rewind(file);
+
+    uint32_t compared    = 0;
+    uint32_t regressions = 0;
+    double   worstChange = -100.0;
+    std::string worstName;
+
+    std::printf("\n");
+
+    while (std::fgets(line, sizeof(line), file)) {
+      if (line[0] == '#' || std::sscanf(line, "%15s %63s %63s %lf", target, name, stage, &baseline) != 4)
+        continue;
+
+      for (size_t t = 0; t < targets.size(); t++) {
+        for (size_t c = 0; c < corpus.size(); c++) {
+          for (size_t s = 0; s < Stages.size(); s++) {
+            if (std::strcmp(target, targetName(targets[t]))
+             || std::strcmp(name, corpus[c].name.c_str())
+             || std::strcmp(stage, Stages[s].name)
+             || baseline <= 0.0)
+              continue;
+
+            double base = baseline * scale;
+            double now = double(fastest[t * corpus.size() + c][s]);
+            double change = 100.0 * (now - base) / base;
+            bool regressed = change > threshold && now - base > MinChangeNs;
+
+            if (change > worstChange) {
+              worstChange = change;
+              worstName = std::string(target) + " " + name + " " + stage;
+            }
+
+            if (regressed) {
+              if (!regressions)
+                std::printf("%6s %10s %12s %12s %12s %10s\n", "target", "shader", "stage", "base (us)", "now (us)", "change");
+
+              std::printf("%6s %10s %12s %12.2f %12.2f %9.1f%%  REGRESSION\n",
+                target, name, stage, base / 1.0e3, now / 1.0e3, change);
+            }
+
+            compared    += 1;
+            regressions += regressed ? 1 : 0;
+          }
+        }
+      }
+    }
+
+    std::fclose(file);
+
+    if (!compared) {
+      std::fprintf(stderr, "%s: No matching entries\n", baselinePath);
+      return 1;
+    }
+
+    std::printf("%u entries compared, baseline scaled by %.2f, largest change %+.1f%% (%s)\n",
+      compared, scale, worstChange, worstName.c_str());
+
+    if (regressions) {
+      std::fprintf(stderr, "%u entries regressed by more than %.0f%%\n", regressions, threshold);
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <spirv/spirv_module.h>
+
+using namespace dxvk;
+
+namespace {
+
+  using Clock = std::chrono::high_resolution_clock;
+
+  /**
+   * \brief Emits a module with the given number of blocks
+   *
+   * Every block is a conditional whose header is inserted
+   * after its body has been emitted, the way the DXBC
+   * compiler handles structured control flow.
+   * \param [in] module Module to emit code into
+   * \param [in] count Number of conditional blocks
+   * \param [in] depth Maximum nesting depth
+   */
+  void emitBlocks(SpirvModule& module, uint32_t count, uint32_t depth) {
+    uint32_t voidType = module.defVoidType();
+    uint32_t boolType = module.defBoolType();
+    uint32_t uintType = module.defIntType(32, 0);
+
+    uint32_t funcId = module.allocateId();
+    module.functionBegin(voidType, funcId,
+      module.defFunctionType(voidType, 0, nullptr),
+      spv::FunctionControlMaskNone);
+    module.opLabel(module.allocateId());
+
+    struct Block {
+      size_t   headerPtr;
+      uint32_t condId;
+      uint32_t labelIf;
+      uint32_t labelEnd;
+    };
+
+    std::vector<Block> blocks;
+    uint32_t value = module.constu32(1);
+
+    for (uint32_t i = 0; i < count; i++) {
+      Block block;
+      block.condId    = module.opINotEqual(boolType, value, module.constu32(0));
+      block.labelIf   = module.allocateId();
+      block.labelEnd  = module.allocateId();
+      block.headerPtr = module.getInsertionPtr();
+      blocks.push_back(block);
+
+      module.opLabel(block.labelIf);
+
+      for (uint32_t j = 0; j < 8; j++)
+        value = module.opIAdd(uintType, value, module.constu32(j));
+
+      if (blocks.size() == depth || i + 1 == count) {
+        while (!blocks.empty()) {
+          block = blocks.back();
+          blocks.pop_back();
+
+          module.beginInsertion(block.headerPtr);
+          module.opSelectionMerge(block.labelEnd, spv::SelectionControlMaskNone);
+          module.opBranchConditional(block.condId, block.labelIf, block.labelEnd);
+          module.endInsertion();
+
+          module.opBranch(block.labelEnd);
+          module.opLabel(block.labelEnd);
+        }
+      }
+    }
+
+    module.opReturn();
+    module.functionEnd();
+  }
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t maxCount = argc > 1 ? std::atoi(argv[1]) : 65536;
+  uint32_t depth    = argc > 2 ? std::atoi(argv[2]) : 4;
+
+  std::printf("nesting depth: %u\n", depth);
+
+  std::printf("%10s %10s %12s %12s %14s %10s\n",
+    "blocks", "dwords", "emit (ms)", "ns/dword", "compile (ms)", "into (ms)");
+
+  for (uint32_t count = 1024; count <= maxCount; count *= 2) {
+    SpirvModule module(spvVersion(1, 3));
+
+    auto t0 = Clock::now();
+    emitBlocks(module, count, depth);
+    auto t1 = Clock::now();
+    SpirvCodeBuffer code = module.compile();
+    auto t2 = Clock::now();
+
+    std::vector<uint32_t> dst(module.compileInto(nullptr, 0));
+
+    auto t3 = Clock::now();
+    module.compileInto(dst.data(), dst.size());
+    auto t4 = Clock::now();
+
+    double emitNs = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    double compileMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    double intoMs = std::chrono::duration<double, std::milli>(t4 - t3).count();
+
+    std::printf("%10u %10u %12.3f %12.2f %14.3f %10.3f\n", count, code.dwords(),
+      emitNs / 1.0e6, emitNs / double(code.dwords()), compileMs, intoMs);
+  }
+
+  return 0;
+}
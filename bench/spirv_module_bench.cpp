@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <spirv/spirv_module.h>
+
+using namespace dxvk;
+
+namespace {
+
+  using Clock = std::chrono::high_resolution_clock;
+
+  /**
+   * \brief Emits a module with the given number of constants
+   *
+   * Each iteration declares four unique scalar constants and
+   * one vector composite, then looks all of them up again the
+   * way the DXBC compiler does for repeated immediates.
+   *
+   * Every lookup takes a constant number of probes, but the
+   * declarations and their index grow with the count, so the
+   * time per constant still rises once they no longer fit
+   * into the CPU caches.
+   * \param [in] count Number of vector constants
+   * \returns Size of the compiled module, in dwords
+   */
+  uint32_t emitConstants(uint32_t count) {
+    SpirvModule module(spvVersion(1, 3));
+
+    for (uint32_t pass = 0; pass < 2; pass++) {
+      for (uint32_t i = 0; i < count; i++) {
+        float base = float(4 * i);
+
+        module.constvec4f32(base + 0.0f, base + 1.0f, base + 2.0f, base + 3.0f);
+        module.constu32(i);
+      }
+    }
+
+    return module.compile().dwords();
+  }
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t maxCount = argc > 1 ? std::atoi(argv[1]) : 32768;
+
+  std::printf("%10s %10s %12s %12s\n", "constants", "dwords", "total (ms)", "ns/const");
+
+  for (uint32_t count = 1024; count <= maxCount; count *= 2) {
+    auto t0 = Clock::now();
+    uint32_t dwords = emitConstants(count);
+    auto t1 = Clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+    std::printf("%10u %10u %12.3f %12.1f\n", count, dwords,
+      ns / 1.0e6, ns / double(count));
+  }
+
+  return 0;
+}
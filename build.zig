@@ -21,6 +21,7 @@ pub fn build(b: *std.Build) !void {
         .files = &.{
             "spirv_module.cpp",
             "spirv_code_buffer.cpp",
+            "spirv_compression.cpp",
         },
     });
     spirv.addIncludePath(b.path("vendor/spirv_cross"));
@@ -58,8 +59,10 @@ pub fn build(b: *std.Build) !void {
         .files = &.{
             "log/log.cpp",
             "log/log_debug.cpp",
+            "thread.cpp",
             "util_env.cpp",
             "util_string.cpp",
+            "util_work_pool.cpp",
         },
     });
     dxbc.addIncludePath(b.path("vendor/util"));
@@ -107,7 +110,13 @@ pub fn build(b: *std.Build) !void {
         }),
     });
     driver.linkLibCpp();
-    driver.addCSourceFile(.{ .file = b.path("src/driver.cpp") });
+    driver.addCSourceFiles(.{
+        .root = b.path("src"),
+        .files = &.{
+            "driver.cpp",
+            "translation_cache.cpp",
+        },
+    });
     driver.addIncludePath(b.path("vendor/dxbc"));
     driver.addIncludePath(b.path("vendor/util"));
     driver.addIncludePath(b.path("vendor"));
@@ -139,4 +148,107 @@ pub fn build(b: *std.Build) !void {
     const run_artifact = b.addRunArtifact(exe);
     if (b.args) |args| run_artifact.addArgs(args);
     run.dependOn(&run_artifact.step);
+
+    const pipeline_bench = b.addExecutable(.{
+        .name = "pipeline_bench",
+        .root_module = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    pipeline_bench.linkLibCpp();
+    pipeline_bench.addCSourceFile(.{ .file = b.path("bench/pipeline_bench.cpp") });
+    pipeline_bench.addIncludePath(b.path("src"));
+    pipeline_bench.addIncludePath(b.path("vendor"));
+    pipeline_bench.addIncludePath(b.path("vendor/util"));
+    pipeline_bench.addIncludePath(vk.path("include"));
+    pipeline_bench.root_module.addCMacro("BENCH_OPTIMIZE", b.fmt("\"{s}\"", .{@tagName(optimize)}));
+    pipeline_bench.linkLibrary(driver);
+
+    const bench = b.step("bench", "Measure per-stage translation latency");
+    const bench_artifact = b.addRunArtifact(pipeline_bench);
+    if (b.args) |args| bench_artifact.addArgs(args);
+    bench.dependOn(&bench_artifact.step);
+
+    // Timings on a loaded machine are too noisy to gate on, so the
+    // comparison is a separate step to run on an idle machine. The
+    // committed baseline is recorded with ReleaseFast, and the bench
+    // refuses baselines from other builds anyway.
+    const bench_gate = b.step("bench-gate", "Compare per-stage translation latency against bench/pipeline_baseline.txt");
+    if (optimize == .ReleaseFast) {
+        const bench_gate_artifact = b.addRunArtifact(pipeline_bench);
+        bench_gate_artifact.addArg("-b");
+        bench_gate_artifact.addFileArg(b.path("bench/pipeline_baseline.txt"));
+        if (b.args) |args| bench_gate_artifact.addArgs(args);
+        bench_gate.dependOn(&bench_gate_artifact.step);
+    } else {
+        bench_gate.dependOn(&b.addFail("bench-gate requires -Doptimize=ReleaseFast").step);
+    }
+
+    const bench_baseline = b.step("bench-baseline", "Record per-stage translation latency to bench/pipeline_baseline.txt");
+    if (optimize == .ReleaseFast) {
+        const bench_baseline_artifact = b.addRunArtifact(pipeline_bench);
+        bench_baseline_artifact.addArgs(&.{ "-w", b.pathFromRoot("bench/pipeline_baseline.txt") });
+        if (b.args) |args| bench_baseline_artifact.addArgs(args);
+        bench_baseline.dependOn(&bench_baseline_artifact.step);
+    } else {
+        bench_baseline.dependOn(&b.addFail("bench-baseline requires -Doptimize=ReleaseFast").step);
+    }
+
+    const spirv_bench = b.addExecutable(.{
+        .name = "spirv_module_bench",
+        .root_module = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    spirv_bench.linkLibCpp();
+    spirv_bench.addCSourceFile(.{ .file = b.path("bench/spirv_module_bench.cpp") });
+    spirv_bench.addIncludePath(b.path("vendor"));
+    spirv_bench.addIncludePath(b.path("vendor/spirv_cross"));
+    spirv_bench.linkLibrary(spirv);
+
+    const bench_spirv = b.step("bench-spirv", "Measure SPIR-V type and constant declaration scaling");
+    const bench_spirv_artifact = b.addRunArtifact(spirv_bench);
+    if (b.args) |args| bench_spirv_artifact.addArgs(args);
+    bench_spirv.dependOn(&bench_spirv_artifact.step);
+
+    const emit_bench = b.addExecutable(.{
+        .name = "spirv_code_buffer_bench",
+        .root_module = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    emit_bench.linkLibCpp();
+    emit_bench.addCSourceFile(.{ .file = b.path("bench/spirv_code_buffer_bench.cpp") });
+    emit_bench.addIncludePath(b.path("vendor"));
+    emit_bench.addIncludePath(b.path("vendor/spirv_cross"));
+    emit_bench.linkLibrary(spirv);
+
+    const bench_emit = b.step("bench-spirv-code-buffer", "Measure SPIR-V code emission scaling with inserted control flow");
+    const bench_emit_artifact = b.addRunArtifact(emit_bench);
+    if (b.args) |args| bench_emit_artifact.addArgs(args);
+    bench_emit.dependOn(&bench_emit_artifact.step);
+
+    const decode_bench = b.addExecutable(.{
+        .name = "dxbc_decode_bench",
+        .root_module = b.createModule(.{
+            .target = target,
+            .optimize = optimize,
+        }),
+    });
+    decode_bench.linkLibCpp();
+    decode_bench.addCSourceFile(.{ .file = b.path("bench/dxbc_decode_bench.cpp") });
+    decode_bench.addIncludePath(b.path("vendor"));
+    decode_bench.addIncludePath(b.path("vendor/util"));
+    decode_bench.addIncludePath(b.path("vendor/spirv_cross"));
+    decode_bench.addIncludePath(vk.path("include"));
+    decode_bench.linkLibrary(dxbc);
+    decode_bench.linkLibrary(spirv);
+
+    const bench_decode = b.step("bench-decode", "Measure DXBC instruction decode throughput");
+    const bench_decode_artifact = b.addRunArtifact(decode_bench);
+    if (b.args) |args| bench_decode_artifact.addArgs(args);
+    bench_decode.dependOn(&bench_decode_artifact.step);
 }
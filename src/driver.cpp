@@ -1,67 +1,729 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
+
 #include "driver.h"
+#include "translation_cache.h"
+#include <dxbc_header.h>
 #include <dxbc_module.h>
+#include <dxvk/dxvk_hash.h>
 #include <log/log.h>
+#include <spirv/spirv_compression.h>
+#include <util_arena.h>
+#include <util_work_pool.h>
 #include <spirv_cross/spirv_glsl.hpp>
 #include <spirv_cross/spirv_hlsl.hpp>
+#include <spirv_cross/spirv_parser.hpp>
 
-API const char* APIENTRY decompile_to_glsl(const char* input, size_t inputSize) {
-  try {
-      dxvk::DxbcReader reader(input, inputSize);
-      dxvk::DxbcModule module(reader);
-
-      dxvk::DxbcModuleInfo info;
-      auto result = module.compile(info, "test");
-
-      spirv_cross::CompilerGLSL glsl(result.code.data(), result.code.dwords());
-      spirv_cross::CompilerGLSL::Options options;
-      options.version = 310;
-      options.es = true;
-      glsl.set_common_options(options);
-      
-      glsl.build_combined_image_samplers();
-      std::string compiledString = glsl.compile();
-      
-      char* resultStr = new char[compiledString.size() + 1];
-      std::copy(compiledString.begin(), compiledString.end(), resultStr);
-      resultStr[compiledString.size()] = '\0';
-      return resultStr;
-  } catch (const std::exception& e) {
-      std::cerr << "Error: " << e.what() << std::endl;
-      return nullptr;
+namespace {
+
+  /**
+   * \brief Cache format version
+   *
+   * Must be bumped whenever a change to the compiler or the
+   * backends affects the output for an unchanged input.
+   */
+  constexpr uint32_t CacheFormatVersion = 1;
+
+  dxvk::mutex                              g_cacheMutex;
+  std::shared_ptr<dxvk::TranslationCache>  g_cache;
+
+
+  /**
+   * \brief Allocation counters
+   *
+   * Sums of the arena statistics of all threads. Each thread
+   * adds the difference since its last report after every
+   * translation, so the counters only see one atomic update
+   * per shader.
+   */
+  struct AllocCounters {
+    std::atomic<uint64_t> translations    = { 0ull };
+    std::atomic<uint64_t> arenaAllocs     = { 0ull };
+    std::atomic<uint64_t> arenaBytes      = { 0ull };
+    std::atomic<uint64_t> heapAllocs      = { 0ull };
+    std::atomic<uint64_t> maxArenaBytes   = { 0ull };
+  };
+
+  AllocCounters g_allocCounters;
+
+
+  /**
+   * \brief Per-thread translation context
+   *
+   * Owns the arena that backs the containers of the DXBC
+   * module, the compiler and the SPIR-V module while a
+   * shader is being translated. The arena is reset after
+   * every shader and keeps its memory, so once it has grown
+   * to fit the largest shader seen on a thread, translating
+   * further shaders no longer allocates for any of these.
+   */
+  struct TranslationContext {
+    dxvk::Arena       arena;
+    dxvk::ArenaStats  reported;
+
+    void report() {
+      dxvk::ArenaStats stats = arena.stats();
+      uint64_t bytes = stats.arenaBytes - reported.arenaBytes;
+
+      g_allocCounters.translations += 1;
+      g_allocCounters.arenaAllocs  += stats.arenaAllocs - reported.arenaAllocs;
+      g_allocCounters.arenaBytes   += bytes;
+      g_allocCounters.heapAllocs   += stats.heapAllocs  - reported.heapAllocs;
+
+      uint64_t max = g_allocCounters.maxArenaBytes.load();
+
+      while (max < bytes && !g_allocCounters.maxArenaBytes.compare_exchange_weak(max, bytes))
+        continue;
+
+      reported = stats;
+    }
+  };
+
+  thread_local TranslationContext t_context;
+
+
+  /**
+   * \brief Returns the shared work pool
+   *
+   * Created on first use with one thread per core and kept
+   * for the lifetime of the process, so that the arenas of
+   * the worker threads stay warm across calls. The pool is
+   * deliberately leaked, since joining threads from a static
+   * destructor can deadlock when the library gets unloaded.
+   */
+  dxvk::WorkPool& getWorkPool() {
+    static dxvk::WorkPool* pool = new dxvk::WorkPool(0);
+    return *pool;
+  }
+
+
+  using Clock = std::chrono::high_resolution_clock;
+
+
+  /**
+   * \brief Stage timer
+   *
+   * Adds the time elapsed since the previous lap to one of
+   * the counters of a stats struct. Does nothing, not even
+   * read the clock, if no stats were requested.
+   */
+  class StageTimer {
+
+  public:
+
+    explicit StageTimer(decompile_stats* stats)
+    : m_stats(stats) {
+      if (m_stats)
+        m_last = Clock::now();
+    }
+
+    void lap(unsigned long long decompile_stats::* counter) {
+      if (!m_stats)
+        return;
+
+      auto now = Clock::now();
+      m_stats->*counter += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count();
+      m_last = now;
+    }
+
+  private:
+
+    decompile_stats*  m_stats;
+    Clock::time_point m_last;
+
+  };
+
+
+  std::shared_ptr<dxvk::TranslationCache> getCache() {
+    std::lock_guard<dxvk::mutex> lock(g_cacheMutex);
+    return g_cache;
+  }
+
+
+  decompile_variant getDefaultVariant(decompile_target target) {
+    decompile_variant variant = { };
+    variant.target = target;
+    return variant;
+  }
+
+
+  dxvk::DxbcOptions getDxbcOptions(const decompile_variant& variant) {
+    dxvk::DxbcOptions options;
+    options.disableMsaa             = variant.dxbc_flags & DECOMPILE_DXBC_DISABLE_MSAA;
+    options.forceSampleRateShading  = variant.dxbc_flags & DECOMPILE_DXBC_FORCE_SAMPLE_RATE_SHADING;
+    options.invariantPosition       = variant.dxbc_flags & DECOMPILE_DXBC_INVARIANT_POSITION;
+    options.zeroInitWorkgroupMemory = variant.dxbc_flags & DECOMPILE_DXBC_ZERO_INIT_WORKGROUP_MEMORY;
+    options.forceVolatileTgsmAccess = variant.dxbc_flags & DECOMPILE_DXBC_FORCE_VOLATILE_TGSM_ACCESS;
+    options.useDepthClipWorkaround  = variant.dxbc_flags & DECOMPILE_DXBC_DEPTH_CLIP_WORKAROUND;
+    return options;
+  }
+
+
+  spirv_cross::CompilerGLSL::Options getGlslOptions(const decompile_variant& variant) {
+    spirv_cross::CompilerGLSL::Options glsl_options;
+    glsl_options.es = !variant.glsl_desktop;
+    glsl_options.version = variant.glsl_version ? variant.glsl_version
+      : glsl_options.es ? 310 : 450;
+    return glsl_options;
+  }
+
+
+  /**
+   * \brief Checks whether a variant's GLSL version exists
+   *
+   * Only GLSL targets use the version. ES and desktop GLSL
+   * have separate version numbers, e.g. 310 only exists
+   * as an ES version, and 450 only as a desktop version.
+   */
+  bool isValidGlslVersion(const decompile_variant& variant) {
+    static const std::array<uint32_t, 4> esVersions = {
+      100, 300, 310, 320 };
+
+    static const std::array<uint32_t, 13> desktopVersions = {
+      110, 120, 130, 140, 150, 330, 400, 410, 420, 430, 440, 450, 460 };
+
+    if (variant.target != DECOMPILE_TARGET_GLSL)
+      return true;
+
+    auto options = getGlslOptions(variant);
+
+    return options.es
+      ? std::find(esVersions.begin(), esVersions.end(), options.version) != esVersions.end()
+      : std::find(desktopVersions.begin(), desktopVersions.end(), options.version) != desktopVersions.end();
+  }
+
+
+  spirv_cross::CompilerHLSL::Options getHlslOptions(const decompile_variant& variant) {
+    spirv_cross::CompilerHLSL::Options hlsl_options;
+    hlsl_options.shader_model = variant.hlsl_shader_model ? variant.hlsl_shader_model : 40;
+    hlsl_options.point_size_compat = true;
+    return hlsl_options;
+  }
+
+
+  std::vector<uint32_t> compileSpirv(dxvk::DxbcReader& reader, const dxvk::DxbcModuleInfo& info, decompile_stats* stats) {
+    StageTimer timer(stats);
+    std::vector<uint32_t> code;
+
+    dxvk::DxbcModule module(reader);
+    timer.lap(&decompile_stats::parse_ns);
+
+    dxvk::DxbcCompileStats compileStats;
+    module.compile(info, "test", code, stats ? &compileStats : nullptr);
+
+    if (stats) {
+      stats->analysis_ns       += compileStats.analysis.count();
+      stats->compile_ns        += compileStats.compile.count();
+      stats->dxbc_instructions  = module.program().size();
+    }
+
+    return code;
+  }
+
+
+  /**
+   * \brief Parses SPIR-V for the backends
+   *
+   * The parser takes ownership of the words, so code
+   * compiled straight into a vector is never copied.
+   */
+  spirv_cross::ParsedIR parseSpirv(std::vector<uint32_t>&& code, decompile_stats* stats) {
+    StageTimer timer(stats);
+
+    if (stats) {
+      stats->spirv_size = code.size() * sizeof(uint32_t);
+      stats->spirv_instructions = 0;
+
+      for (size_t i = 5; i < code.size(); i += std::max(code[i] >> 16, 1u))
+        stats->spirv_instructions += 1;
+    }
+
+    spirv_cross::Parser parser(std::move(code));
+    parser.parse();
+
+    timer.lap(&decompile_stats::spirv_parse_ns);
+    return std::move(parser.get_parsed_ir());
+  }
+
+
+  /**
+   * \brief Output sink
+   *
+   * Receives generated source in chunks, either for a
+   * caller-provided buffer or for a callback. Source that
+   * does not fit into the buffer is only counted, so that
+   * the caller can learn the required size.
+   */
+  struct OutputSink {
+    char*               buffer      = nullptr;
+    size_t              bufferSize  = 0;
+    decompile_write_fn  write       = nullptr;
+    void*               userData    = nullptr;
+    size_t              size        = 0;
+
+    void put(const char* data, size_t length) {
+      if (write)
+        write(userData, data, length);
+      else if (buffer && data != buffer + size && size + length <= bufferSize)
+        std::memcpy(buffer + size, data, length);
+
+      size += length;
+    }
+  };
+
+
+  /**
+   * \brief Creates a backend for a variant
+   *
+   * \param [in] variant Output configuration
+   * \param [in] ir Parsed SPIR-V, copied if passed as
+   *    an lvalue so that it can be shared by several
+   *    backends
+   */
+  template<typename IR>
+  std::unique_ptr<spirv_cross::CompilerGLSL> createBackend(const decompile_variant& variant, IR&& ir) {
+    if (variant.target == DECOMPILE_TARGET_HLSL) {
+      auto hlsl = std::make_unique<spirv_cross::CompilerHLSL>(std::forward<IR>(ir));
+      hlsl->set_common_options(getGlslOptions(variant));
+      hlsl->set_hlsl_options(getHlslOptions(variant));
+
+      hlsl->build_combined_image_samplers();
+      return hlsl;
+    } else {
+      auto glsl = std::make_unique<spirv_cross::CompilerGLSL>(std::forward<IR>(ir));
+      glsl->set_common_options(getGlslOptions(variant));
+
+      glsl->build_combined_image_samplers();
+      return glsl;
+    }
+  }
+
+
+  std::string emit(decompile_target target, spirv_cross::ParsedIR&& ir, decompile_stats* stats) {
+    StageTimer timer(stats);
+
+    std::string result = createBackend(getDefaultVariant(target), std::move(ir))->compile();
+
+    timer.lap(&decompile_stats::emit_ns);
+    return result;
+  }
+
+
+  /**
+   * \brief Emits source into a sink
+   *
+   * When writing to a buffer, the backend generates
+   * the source directly into it, so that nothing has
+   * to be copied unless the buffer is too small.
+   */
+  void emit(decompile_target target, spirv_cross::ParsedIR&& ir, decompile_stats* stats, OutputSink& sink) {
+    StageTimer timer(stats);
+
+    auto backend = createBackend(getDefaultVariant(target), std::move(ir));
+
+    if (sink.buffer)
+      backend->set_output_target(sink.buffer, sink.bufferSize);
+
+    backend->compile([&sink] (const char* data, size_t length) {
+      sink.put(data, length);
+    });
+
+    timer.lap(&decompile_stats::emit_ns);
+  }
+
+
+  /**
+   * \brief Computes the input part of a cache key
+   *
+   * Uses the checksum stored in the DXBC header. Blobs that
+   * were never signed have an all-zero checksum, so those
+   * are identified by a hash of their contents instead.
+   */
+  void initCacheKey(dxvk::TranslationCacheKey& key, const dxvk::DxbcHeader& header, const char* input, size_t inputSize) {
+    key = dxvk::TranslationCacheKey();
+    key.inputSize = inputSize;
+
+    const auto& checksum = header.checksum();
+    std::copy(checksum.begin(), checksum.end(), key.checksum);
+
+    if (std::any_of(checksum.begin(), checksum.end(), [] (uint8_t b) { return b != 0; }))
+      return;
+
+    // Two FNV-1a passes with different offset bases
+    uint64_t hashes[2] = { 0xcbf29ce484222325ull, 0x84222325cbf29ce4ull };
+
+    for (auto& hash : hashes) {
+      for (size_t i = 0; i < inputSize; i++)
+        hash = (hash ^ uint8_t(input[i])) * 0x100000001b3ull;
+    }
+
+    std::memcpy(key.checksum, hashes, sizeof(hashes));
+  }
+
+
+  std::string translateCached(dxvk::TranslationCache& cache, decompile_target target, const char* input, size_t inputSize, decompile_stats* stats, OutputSink* sink) {
+    dxvk::DxbcReader reader(input, inputSize);
+    dxvk::DxbcHeader header(reader);
+
+    dxvk::DxbcModuleInfo info;
+
+    dxvk::DxvkHashState spirvHash;
+    spirvHash.add(CacheFormatVersion);
+    spirvHash.add(info.options.hash());
+
+    // The text key covers everything the SPIR-V key does,
+    // plus all backend options.
+    auto glslOptions = getGlslOptions(getDefaultVariant(target));
+    auto hlslOptions = getHlslOptions(getDefaultVariant(target));
+
+    dxvk::DxvkHashState textHash = spirvHash;
+    textHash.add(uint32_t(target));
+    textHash.add(glslOptions.version);
+    textHash.add(uint32_t(glslOptions.es));
+
+    if (target == DECOMPILE_TARGET_HLSL) {
+      textHash.add(hlslOptions.shader_model);
+      textHash.add(uint32_t(hlslOptions.point_size_compat));
+    }
+
+    dxvk::TranslationCacheKey textKey;
+    initCacheKey(textKey, header, input, inputSize);
+    textKey.optionHash = size_t(textHash);
+    textKey.kind = target == DECOMPILE_TARGET_HLSL
+      ? dxvk::TranslationCacheKind::Hlsl
+      : dxvk::TranslationCacheKind::Glsl;
+
+    std::vector<char> data;
+
+    if (cache.lookup(textKey, data)) {
+      if (!sink)
+        return std::string(data.begin(), data.end());
+
+      sink->put(data.data(), data.size());
+      return std::string();
+    }
+
+    // SPIR-V entries are shared between all backends, stored
+    // as the uncompressed dword count followed by the data.
+    dxvk::TranslationCacheKey spirvKey = textKey;
+    spirvKey.optionHash = size_t(spirvHash);
+    spirvKey.kind = dxvk::TranslationCacheKind::Spirv;
+
+    std::vector<uint32_t> code;
+    uint64_t dwords = 0;
+
+    if (cache.lookup(spirvKey, data) && data.size() >= sizeof(dwords)
+     && (data.size() - sizeof(dwords)) % sizeof(uint32_t) == 0) {
+      std::memcpy(&dwords, data.data(), sizeof(dwords));
+
+      std::vector<uint32_t> compressed((data.size() - sizeof(dwords)) / sizeof(uint32_t));
+      std::memcpy(compressed.data(), data.data() + sizeof(dwords), compressed.size() * sizeof(uint32_t));
+
+      // Every compressed dword holds at most two code dwords. Entries
+      // that fail this or decompression are treated as a cache miss.
+      if (dwords <= std::numeric_limits<uint32_t>::max() && dwords <= 2 * compressed.size()) {
+        code.resize(dwords);
+
+        if (!dxvk::SpirvCompressedBuffer(dwords, std::move(compressed)).decompressInto(code.data()))
+          code.clear();
+      }
+    }
+
+    if (code.empty()) {
+      dxvk::DxbcReader moduleReader(input, inputSize);
+      code = compileSpirv(moduleReader, info, stats);
+
+      dxvk::SpirvCodeBuffer buffer(code.size(), code.data());
+      dxvk::SpirvCompressedBuffer compressed(buffer);
+      dwords = compressed.dwords();
+
+      data.resize(sizeof(dwords) + compressed.code().size() * sizeof(uint32_t));
+      std::memcpy(data.data(), &dwords, sizeof(dwords));
+      std::memcpy(data.data() + sizeof(dwords), compressed.code().data(), compressed.code().size() * sizeof(uint32_t));
+
+      cache.store(spirvKey, data.data(), data.size());
+    }
+
+    std::string text = emit(target, parseSpirv(std::move(code), stats), stats);
+    cache.store(textKey, text.data(), text.size());
+
+    if (!sink)
+      return text;
+
+    sink->put(text.data(), text.size());
+    return std::string();
+  }
+
+
+  /**
+   * \brief Translates a shader
+   *
+   * \returns Generated source, or an empty string if
+   *    the source was written to \c sink instead
+   */
+  std::string translate(decompile_target target, const char* input, size_t inputSize, decompile_stats* stats, OutputSink* sink) {
+    auto cache = getCache();
+
+    if (cache)
+      return translateCached(*cache, target, input, inputSize, stats, sink);
+
+    dxvk::DxbcReader reader(input, inputSize);
+    auto ir = parseSpirv(compileSpirv(reader, dxvk::DxbcModuleInfo(), stats), stats);
+
+    if (!sink)
+      return emit(target, std::move(ir), stats);
+
+    emit(target, std::move(ir), stats, *sink);
+    return std::string();
+  }
+
+
+  const char* copyString(const std::string& str) {
+    char* result = new char[str.size() + 1];
+    std::copy(str.begin(), str.end(), result);
+    result[str.size()] = '\0';
+    return result;
+  }
+
+
+  /**
+   * \brief Runs a function and maps exceptions to a status
+   *
+   * \param [out] error Error message on failure
+   * \param [in] proc Function to run
+   * \returns Status code
+   */
+  template<typename Proc>
+  decompile_status runChecked(std::string& error, const Proc& proc) {
+    try {
+      proc();
+      return DECOMPILE_SUCCESS;
+    } catch (const dxvk::DxvkError& e) {
+      error = e.message();
+      return DECOMPILE_ERROR_DXBC;
+    } catch (const spirv_cross::CompilerError& e) {
+      error = e.what();
+      return DECOMPILE_ERROR_SPIRV_CROSS;
+    } catch (const std::exception& e) {
+      error = e.what();
+      return DECOMPILE_ERROR_UNKNOWN;
+    }
+  }
+
+
+  decompile_result translateChecked(decompile_target target, const char* input, size_t inputSize, std::string& error, decompile_stats* stats = nullptr, OutputSink* sink = nullptr) {
+    decompile_result result = { };
+
+    if (stats)
+      *stats = decompile_stats();
+
+    StageTimer timer(stats);
+
+    if (!input || !inputSize) {
+      result.status = DECOMPILE_ERROR_INVALID_INPUT;
+      error = "No input provided";
+      return result;
+    }
+
+    std::string compiledString;
+
+    result.status = runChecked(error, [&] {
+      dxvk::ArenaScope scope(t_context.arena);
+      compiledString = translate(target, input, inputSize, stats, sink);
+    });
+
+    // Failed translations count as well, so that the
+    // counters cover every input that was attempted
+    if (stats)
+      stats->arena_bytes_allocated = t_context.arena.stats().arenaBytes - t_context.reported.arenaBytes;
+
+    t_context.report();
+
+    if (result.status == DECOMPILE_SUCCESS) {
+      result.status = runChecked(error, [&] {
+        if (sink) {
+          result.output_size = sink->size;
+        } else {
+          result.output      = copyString(compiledString);
+          result.output_size = compiledString.size();
+        }
+      });
+    }
+
+    timer.lap(&decompile_stats::total_ns);
+    return result;
+  }
+
+
+  /**
+   * \brief SPIR-V shared by several variants
+   *
+   * Variants with equal DXBC options get the same SPIR-V,
+   * so it is compiled and parsed once. Each backend needs
+   * its own parsed module, so all users but the last one
+   * get a copy, and the last one takes the original.
+   */
+  struct SharedSpirv {
+    dxvk::DxbcOptions     options;
+    spirv_cross::ParsedIR ir;
+    decompile_status      status = DECOMPILE_SUCCESS;
+    std::string           error;
+    size_t                lastUser = 0;
+  };
+
+
+  void translateVariants(
+          const char*               input,
+          size_t                    inputSize,
+          const decompile_variant*  variants,
+          decompile_result*         results,
+          size_t                    variantCount,
+          unsigned int              threadCount) {
+    constexpr size_t NoModule = ~size_t(0);
+
+    std::vector<SharedSpirv> modules;
+    std::vector<size_t> moduleIndices(variantCount, NoModule);
+
+    for (size_t i = 0; i < variantCount; i++) {
+      // Reject bad options up front, so that they do
+      // not cause SPIR-V to be compiled for nothing
+      if (!isValidGlslVersion(variants[i])) {
+        results[i] = { };
+        results[i].status = DECOMPILE_ERROR_INVALID_INPUT;
+
+        dxvk::Logger::debug(dxvk::str::format("decompile_variants: Variant ", i,
+          ": Invalid GLSL version ", variants[i].glsl_version));
+        continue;
+      }
+
+      dxvk::DxbcOptions options = getDxbcOptions(variants[i]);
+
+      auto entry = std::find_if(modules.begin(), modules.end(),
+        [&options] (const SharedSpirv& m) { return m.options.eq(options); });
+
+      if (entry == modules.end()) {
+        entry = modules.emplace(modules.end());
+        entry->options = options;
+      }
+
+      entry->lastUser = i;
+      moduleIndices[i] = entry - modules.begin();
+    }
+
+    if (modules.empty())
+      return;
+
+    // Compile and parse SPIR-V for each option set on
+    // this thread, using a single parsed DXBC module
+    std::string error;
+    decompile_status status = DECOMPILE_ERROR_INVALID_INPUT;
+
+    if (input && inputSize) {
+      status = runChecked(error, [&] {
+        dxvk::ArenaScope scope(t_context.arena);
+
+        dxvk::DxbcReader reader(input, inputSize);
+        dxvk::DxbcModule module(reader);
+
+        for (auto& m : modules) {
+          m.status = runChecked(m.error, [&] {
+            dxvk::DxbcModuleInfo info;
+            info.options = m.options;
+
+            std::vector<uint32_t> code;
+            module.compile(info, "test", code);
+            m.ir = parseSpirv(std::move(code), nullptr);
+          });
+        }
+      });
+
+      t_context.report();
+    } else {
+      error = "No input provided";
+    }
+
+    if (status != DECOMPILE_SUCCESS) {
+      for (auto& m : modules) {
+        m.status = status;
+        m.error  = error;
+      }
+    }
+
+    // Generate source for all variants in parallel. Variants that
+    // copy a shared module run first, so that the last user of each
+    // module can move it into its backend once nobody else reads it.
+    std::vector<uint32_t> order;
+    order.reserve(variantCount);
+
+    for (size_t i = 0; i < variantCount; i++) {
+      if (moduleIndices[i] != NoModule && modules[moduleIndices[i]].lastUser != i)
+        order.push_back(i);
+    }
+
+    size_t copyCount = order.size();
+
+    for (const auto& m : modules)
+      order.push_back(m.lastUser);
+
+    auto emitVariant = [&] (uint32_t i) {
+      SharedSpirv& m = modules[moduleIndices[i]];
+
+      std::string error = m.error;
+      decompile_result result = { };
+      result.status = m.status;
+
+      if (result.status == DECOMPILE_SUCCESS) {
+        result.status = runChecked(error, [&] {
+          std::string text = m.lastUser == i
+            ? createBackend(variants[i], std::move(m.ir))->compile()
+            : createBackend(variants[i], static_cast<const spirv_cross::ParsedIR&>(m.ir))->compile();
+
+          result.output      = copyString(text);
+          result.output_size = text.size();
+        });
+      }
+
+      if (result.status != DECOMPILE_SUCCESS)
+        dxvk::Logger::debug(dxvk::str::format("decompile_variants: Variant ", i, ": ", error));
+
+      results[i] = result;
+    };
+
+    dxvk::WorkPool& pool = getWorkPool();
+
+    pool.run(copyCount, [&] (uint32_t i) {
+      emitVariant(order[i]);
+    }, threadCount);
+
+    pool.run(order.size() - copyCount, [&] (uint32_t i) {
+      emitVariant(order[copyCount + i]);
+    }, threadCount);
   }
+
+
+  const char* translateLegacy(decompile_target target, const char* input, size_t inputSize) {
+    std::string error;
+    decompile_result result = translateChecked(target, input, inputSize, error);
+
+    if (result.status != DECOMPILE_SUCCESS)
+      std::cerr << "Error: " << error << std::endl;
+
+    return result.output;
+  }
+
+}
+
+API const char* APIENTRY decompile_to_glsl(const char* input, size_t inputSize) {
+  return translateLegacy(DECOMPILE_TARGET_GLSL, input, inputSize);
 }
 
 API const char* APIENTRY decompile_to_hlsl(const char* input, size_t inputSize) {
-  try {
-      dxvk::DxbcReader reader(input, inputSize);
-      dxvk::DxbcModule module(reader);
-
-      dxvk::DxbcModuleInfo info;
-      auto result = module.compile(info, "test");
-
-      spirv_cross::CompilerHLSL hlsl(result.code.data(), result.code.dwords());
-      spirv_cross::CompilerGLSL::Options glsl_options;
-      glsl_options.version = 310;
-      glsl_options.es = true;
-      spirv_cross::CompilerHLSL::Options hlsl_options;
-      
-      hlsl_options.shader_model = 40;
-      hlsl_options.point_size_compat = true;
-
-      hlsl.set_common_options(glsl_options);
-      hlsl.set_hlsl_options(hlsl_options);
-      
-      hlsl.build_combined_image_samplers();
-      std::string compiledString = hlsl.compile();
-      
-      char* resultStr = new char[compiledString.size() + 1];
-      std::copy(compiledString.begin(), compiledString.end(), resultStr);
-      resultStr[compiledString.size()] = '\0';
-      return resultStr;
-  } catch (const std::exception& e) {
-      std::cerr << "Error: " << e.what() << std::endl;
-      return nullptr;
-  }
+  return translateLegacy(DECOMPILE_TARGET_HLSL, input, inputSize);
 }
 
 API void APIENTRY free_compiled_string(const char* compiledString) {
@@ -70,4 +732,155 @@ API void APIENTRY free_compiled_string(const char* compiledString) {
   }
 }
 
+API void APIENTRY decompile_batch(
+        decompile_target        target,
+  const decompile_input*        inputs,
+        decompile_result*       results,
+        size_t                  inputCount,
+        unsigned int            threadCount) {
+  if (!inputCount)
+    return;
+
+  getWorkPool().run(inputCount, [=] (uint32_t i) {
+    std::string error;
+    results[i] = translateChecked(target, inputs[i].data, inputs[i].size, error);
+
+    if (results[i].status != DECOMPILE_SUCCESS)
+      dxvk::Logger::debug(dxvk::str::format("decompile_batch: Input ", i, ": ", error));
+  }, threadCount);
+}
+
+API void APIENTRY decompile_variants(
+  const char*                   input,
+        size_t                  inputSize,
+  const decompile_variant*      variants,
+        decompile_result*       results,
+        size_t                  variantCount,
+        unsigned int            threadCount) {
+  if (!variantCount)
+    return;
+
+  translateVariants(input, inputSize, variants, results, variantCount, threadCount);
+}
+
+API decompile_result APIENTRY decompile_with_stats(
+        decompile_target        target,
+  const char*                   input,
+        size_t                  inputSize,
+        decompile_stats*        stats) {
+  std::string error;
+  decompile_result result = translateChecked(target, input, inputSize, error, stats);
+
+  if (result.status != DECOMPILE_SUCCESS)
+    dxvk::Logger::debug(dxvk::str::format("decompile_with_stats: ", error));
+
+  return result;
+}
+
+API decompile_status APIENTRY decompile_to_buffer(
+        decompile_target        target,
+  const char*                   input,
+        size_t                  inputSize,
+        char*                   buffer,
+        size_t                  bufferSize,
+        size_t*                 outputSize) {
+  OutputSink sink;
+  sink.buffer     = bufferSize ? buffer : nullptr;
+  sink.bufferSize = sink.buffer ? bufferSize : 0;
+
+  std::string error;
+  decompile_result result = translateChecked(target, input, inputSize, error, nullptr, &sink);
 
+  if (outputSize)
+    *outputSize = result.output_size;
+
+  if (result.status != DECOMPILE_SUCCESS) {
+    dxvk::Logger::debug(dxvk::str::format("decompile_to_buffer: ", error));
+    return result.status;
+  }
+
+  return result.output_size > sink.bufferSize
+    ? DECOMPILE_ERROR_BUFFER_TOO_SMALL
+    : DECOMPILE_SUCCESS;
+}
+
+API decompile_status APIENTRY decompile_to_callback(
+        decompile_target        target,
+  const char*                   input,
+        size_t                  inputSize,
+        decompile_write_fn      write,
+        void*                   userData,
+        size_t*                 outputSize) {
+  if (!write)
+    return DECOMPILE_ERROR_INVALID_INPUT;
+
+  OutputSink sink;
+  sink.write    = write;
+  sink.userData = userData;
+
+  std::string error;
+  decompile_result result = translateChecked(target, input, inputSize, error, nullptr, &sink);
+
+  if (outputSize)
+    *outputSize = result.output_size;
+
+  if (result.status != DECOMPILE_SUCCESS)
+    dxvk::Logger::debug(dxvk::str::format("decompile_to_callback: ", error));
+
+  return result.status;
+}
+
+API const char* APIENTRY decompile_status_string(decompile_status status) {
+  switch (status) {
+    case DECOMPILE_SUCCESS:                return "success";
+    case DECOMPILE_ERROR_INVALID_INPUT:    return "invalid input";
+    case DECOMPILE_ERROR_DXBC:             return "failed to compile DXBC";
+    case DECOMPILE_ERROR_SPIRV_CROSS:      return "failed to emit shader source";
+    case DECOMPILE_ERROR_CACHE:            return "failed to open cache";
+    case DECOMPILE_ERROR_BUFFER_TOO_SMALL: return "output buffer too small";
+    case DECOMPILE_ERROR_UNKNOWN:          return "unknown error";
+  }
+
+  return "invalid status";
+}
+
+API decompile_status APIENTRY decompile_cache_open(const char* directory, size_t maxSize) {
+  if (!directory || !directory[0])
+    return DECOMPILE_ERROR_INVALID_INPUT;
+
+  try {
+    auto cache = std::make_shared<dxvk::TranslationCache>(
+      directory, maxSize ? maxSize : size_t(256) << 20);
+
+    std::lock_guard<dxvk::mutex> lock(g_cacheMutex);
+    g_cache = std::move(cache);
+    return DECOMPILE_SUCCESS;
+  } catch (const dxvk::DxvkError& e) {
+    dxvk::Logger::err(e.message());
+    return DECOMPILE_ERROR_CACHE;
+  }
+}
+
+API void APIENTRY decompile_cache_close(void) {
+  std::lock_guard<dxvk::mutex> lock(g_cacheMutex);
+  g_cache = nullptr;
+}
+
+API void APIENTRY decompile_get_alloc_stats(decompile_alloc_stats* stats) {
+  if (!stats)
+    return;
+
+  stats->translations              = g_allocCounters.translations.load();
+  stats->arena_allocs              = g_allocCounters.arenaAllocs.load();
+  stats->arena_bytes               = g_allocCounters.arenaBytes.load();
+  stats->heap_allocs               = g_allocCounters.heapAllocs.load();
+  stats->max_arena_bytes_allocated = g_allocCounters.maxArenaBytes.load();
+}
+
+API void APIENTRY decompile_reset_alloc_stats(void) {
+  g_allocCounters.translations    = 0;
+  g_allocCounters.arenaAllocs     = 0;
+  g_allocCounters.arenaBytes      = 0;
+  g_allocCounters.heapAllocs      = 0;
+  g_allocCounters.maxArenaBytes   = 0;
+}
@@ -13,10 +13,184 @@
 extern "C" {
 #endif
 
+typedef enum decompile_target {
+    DECOMPILE_TARGET_GLSL = 0,
+    DECOMPILE_TARGET_HLSL = 1,
+} decompile_target;
+
+typedef enum decompile_status {
+    DECOMPILE_SUCCESS                = 0,
+    DECOMPILE_ERROR_INVALID_INPUT    = 1,
+    DECOMPILE_ERROR_DXBC             = 2,
+    DECOMPILE_ERROR_SPIRV_CROSS      = 3,
+    DECOMPILE_ERROR_UNKNOWN          = 4,
+    DECOMPILE_ERROR_CACHE            = 5,
+    DECOMPILE_ERROR_BUFFER_TOO_SMALL = 6,
+} decompile_status;
+
+/* DXBC compiler options for decompile_variants */
+typedef enum decompile_dxbc_flag {
+    DECOMPILE_DXBC_DISABLE_MSAA               = 1 << 0,
+    DECOMPILE_DXBC_FORCE_SAMPLE_RATE_SHADING  = 1 << 1,
+    DECOMPILE_DXBC_INVARIANT_POSITION         = 1 << 2,
+    DECOMPILE_DXBC_ZERO_INIT_WORKGROUP_MEMORY = 1 << 3,
+    DECOMPILE_DXBC_FORCE_VOLATILE_TGSM_ACCESS = 1 << 4,
+    DECOMPILE_DXBC_DEPTH_CLIP_WORKAROUND      = 1 << 5,
+} decompile_dxbc_flag;
+
+/* One output configuration for decompile_variants. A zero-initialized
+ * variant produces the same output as decompile_to_glsl, or as
+ * decompile_to_hlsl if target is DECOMPILE_TARGET_HLSL. GLSL variants
+ * whose version does not exist for the chosen profile, e.g. desktop 310,
+ * fail with DECOMPILE_ERROR_INVALID_INPUT. */
+typedef struct decompile_variant {
+    decompile_target target;
+    /* GLSL version, e.g. 310 or 450 (0 = 310 for ES, 450 for desktop) */
+    unsigned int     glsl_version;
+    /* Non-zero to generate desktop GLSL rather than GLSL ES */
+    unsigned int     glsl_desktop;
+    /* HLSL shader model times ten, e.g. 40 or 50 (0 = 40) */
+    unsigned int     hlsl_shader_model;
+    /* Combination of decompile_dxbc_flag values */
+    unsigned int     dxbc_flags;
+} decompile_variant;
+
+typedef struct decompile_input {
+    const char* data;
+    size_t      size;
+} decompile_input;
+
+typedef struct decompile_result {
+    decompile_status status;
+    /* Null-terminated output, or NULL on failure. Free with free_compiled_string. */
+    const char*      output;
+    size_t           output_size;
+} decompile_result;
+
+/* Receives generated source in order, in one or more chunks. The data
+ * is not null-terminated and is only valid for the duration of the call. */
+typedef void (APIENTRY *decompile_write_fn)(void* user_data, const char* data, size_t size);
+
+/* Allocation counters, summed over all threads. Each thread translates
+ * shaders using its own arena which is reused from shader to shader, so
+ * once warmed up heap_allocs should stay flat. Allocations made by
+ * spirv_cross while emitting source are not included. */
+typedef struct decompile_alloc_stats {
+    /* Translations attempted, including failed ones */
+    unsigned long long translations;
+    /* Allocations served from translation arenas, and their total size */
+    unsigned long long arena_allocs;
+    unsigned long long arena_bytes;
+    /* Allocations that had to grow an arena */
+    unsigned long long heap_allocs;
+    /* Largest arena_bytes_allocated of a single translation, see
+     * decompile_stats */
+    unsigned long long max_arena_bytes_allocated;
+} decompile_alloc_stats;
+
+/* Statistics for a single translation, see decompile_with_stats. Times
+ * are in nanoseconds. Stages that did not run, e.g. because the result
+ * was found in the translation cache, report zero. */
+typedef struct decompile_stats {
+    /* DXBC container, chunk and instruction decoding */
+    unsigned long long parse_ns;
+    /* Register and resource usage analysis */
+    unsigned long long analysis_ns;
+    /* DXBC to SPIR-V compilation */
+    unsigned long long compile_ns;
+    /* SPIR-V parsing by spirv_cross */
+    unsigned long long spirv_parse_ns;
+    /* GLSL or HLSL generation */
+    unsigned long long emit_ns;
+    /* The whole call, including cache lookups */
+    unsigned long long total_ns;
+    /* Instructions in the DXBC input and the generated SPIR-V */
+    unsigned long long dxbc_instructions;
+    unsigned long long spirv_instructions;
+    /* Size of the generated SPIR-V, in bytes */
+    unsigned long long spirv_size;
+    /* Arena memory handed out during this translation. This includes
+     * memory of containers that were freed or regrown before the
+     * translation finished, since the arena only reclaims memory at
+     * the end. It is therefore the size the arena has to grow to for
+     * this shader, not the amount of memory live at any one time. */
+    unsigned long long arena_bytes_allocated;
+} decompile_stats;
+
 API const char* APIENTRY decompile_to_glsl(const char* input, size_t input_size);
 API const char* APIENTRY decompile_to_hlsl(const char* input, size_t input_size);
 API void APIENTRY free_compiled_string(const char* compiledString);
 
+/* Translates input_count blobs on thread_count threads (0 = one per core).
+ * results[i] always corresponds to inputs[i]. All batch and variant calls
+ * share one pool with a thread per core, so thread_count is capped at the
+ * core count, and calls made from different threads run one at a time. */
+API void APIENTRY decompile_batch(
+    decompile_target        target,
+    const decompile_input*  inputs,
+    decompile_result*       results,
+    size_t                  input_count,
+    unsigned int            thread_count);
+
+/* Translates a single blob and fills in stats unless it is NULL. The
+ * stats are only collected when asked for, so passing NULL costs nothing. */
+API decompile_result APIENTRY decompile_with_stats(
+    decompile_target        target,
+    const char*             input,
+    size_t                  input_size,
+    decompile_stats*        stats);
+
+/* Translates one blob into variant_count variants. The DXBC is parsed
+ * once, variants with equal dxbc_flags share the same SPIR-V, and variants
+ * with equal SPIR-V share the parsed module. Source generation then runs
+ * on thread_count threads (0 = one per core), using the same pool as
+ * decompile_batch. results[i] always corresponds to variants[i]. The
+ * translation cache is not used. */
+API void APIENTRY decompile_variants(
+    const char*               input,
+    size_t                    input_size,
+    const decompile_variant*  variants,
+    decompile_result*         results,
+    size_t                    variant_count,
+    unsigned int              thread_count);
+
+/* Generates source straight into buffer, without a terminating null, and
+ * sets *output_size to its length. If the source is longer than
+ * buffer_size, returns DECOMPILE_ERROR_BUFFER_TOO_SMALL with the required
+ * size in *output_size, and the buffer contents are undefined. Passing a
+ * NULL buffer queries the size. */
+API decompile_status APIENTRY decompile_to_buffer(
+    decompile_target        target,
+    const char*             input,
+    size_t                  input_size,
+    char*                   buffer,
+    size_t                  buffer_size,
+    size_t*                 output_size);
+
+/* Passes the generated source to write, and sets *output_size to the
+ * total length. Nothing is written if translation fails. */
+API decompile_status APIENTRY decompile_to_callback(
+    decompile_target        target,
+    const char*             input,
+    size_t                  input_size,
+    decompile_write_fn      write,
+    void*                   user_data,
+    size_t*                 output_size);
+
+/* Enables a persistent translation cache in directory, shared by all
+ * calls and by other processes using the same directory. Entries are
+ * evicted oldest first once the cache exceeds max_size bytes
+ * (0 = 256 MiB). Replaces any previously opened cache. */
+API decompile_status APIENTRY decompile_cache_open(const char* directory, size_t max_size);
+
+/* Disables the translation cache. */
+API void APIENTRY decompile_cache_close(void);
+
+API void APIENTRY decompile_get_alloc_stats(decompile_alloc_stats* stats);
+API void APIENTRY decompile_reset_alloc_stats(void);
+
+API const char* APIENTRY decompile_status_string(decompile_status status);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
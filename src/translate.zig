@@ -3,6 +3,22 @@ const d2g = @import("d2g");
 
 const Output = enum { glsl, hlsl };
 
+/// Largest input file that is read
+const max_input_size = 100 * 1024 * 1024;
+
+/// Batch mode stops reading inputs for a chunk once either limit
+/// is reached, and translates and writes the chunk before reading on.
+const max_chunk_entries = 256;
+const max_chunk_bytes = 64 * 1024 * 1024;
+
+const BatchOptions = struct {
+    dir_path: ?[]const u8 = null,
+    list_path: ?[]const u8 = null,
+    out_dir_path: ?[]const u8 = null,
+    threads: u32 = 0,
+    stats: bool = false,
+};
+
 pub fn main() !void {
     const allocator = std.heap.smp_allocator;
 
@@ -12,22 +28,54 @@ pub fn main() !void {
 
     var file_path: ?[]const u8 = null;
     var output: Output = .hlsl;
+    var batch: BatchOptions = .{};
+    var cache_path: ?[]const u8 = null;
 
     while (args.next()) |arg| {
         if (std.mem.eql(u8, arg, "-g")) {
             output = .glsl;
         } else if (std.mem.eql(u8, arg, "-h")) {
             output = .hlsl;
+        } else if (std.mem.eql(u8, arg, "-d")) {
+            batch.dir_path = args.next() orelse usage();
+        } else if (std.mem.eql(u8, arg, "-l")) {
+            batch.list_path = args.next() orelse usage();
+        } else if (std.mem.eql(u8, arg, "-o")) {
+            batch.out_dir_path = args.next() orelse usage();
+        } else if (std.mem.eql(u8, arg, "-s")) {
+            batch.stats = true;
+        } else if (std.mem.eql(u8, arg, "-c")) {
+            cache_path = args.next() orelse usage();
+        } else if (std.mem.eql(u8, arg, "-j")) {
+            const count = args.next() orelse usage();
+            batch.threads = std.fmt.parseInt(u32, count, 10) catch usage();
         } else {
             if (file_path != null) return error.TwoFilesGiven;
             file_path = arg;
         }
-    } 
+    }
+
+    if (cache_path) |path| {
+        const path_z = try allocator.dupeZ(u8, path);
+        defer allocator.free(path_z);
+
+        const status = d2g.decompile_cache_open(path_z.ptr, 0);
+        if (status != d2g.DECOMPILE_SUCCESS) {
+            std.debug.print("{s}: {s}\n", .{ path, std.mem.span(d2g.decompile_status_string(status)) });
+            return error.FailedToOpenCache;
+        }
+    }
+    defer if (cache_path != null) d2g.decompile_cache_close();
+
+    if (batch.dir_path != null or batch.list_path != null) {
+        if (file_path != null) usage();
+        return translateBatch(allocator, output, batch);
+    }
 
     const contents = try std.fs.cwd().readFileAlloc(
         allocator,
         file_path orelse return error.NoFileProvided,
-        100 * 1024 * 1024,
+        max_input_size,
     );
     defer allocator.free(contents);
 
@@ -40,14 +88,175 @@ pub fn main() !void {
     std.debug.print("{s}\n", .{compiled});
 }
 
+/// A shader blob to translate. `name` is the path relative to the
+/// input directory, or the path given in a list file if it is
+/// relative and stays below the working directory, and its base
+/// name otherwise. `read_error` is set if the file could not be read.
+const Entry = struct {
+    path: []const u8,
+    name: []const u8,
+    read_error: ?anyerror = null,
+};
+
+fn translateBatch(allocator: std.mem.Allocator, output: Output, batch: BatchOptions) !void {
+    var arena_state = std.heap.ArenaAllocator.init(allocator);
+    defer arena_state.deinit();
+    const arena = arena_state.allocator();
+
+    var entries = std.ArrayList(Entry).init(arena);
+    if (batch.dir_path) |dir_path| try collectDir(arena, &entries, dir_path);
+    if (batch.list_path) |list_path| try collectList(arena, &entries, list_path);
+
+    const stderr = std.io.getStdErr().writer();
+
+    if (batch.out_dir_path != null) {
+        // Two inputs with the same name would silently overwrite
+        // each other's output, so refuse to start at all.
+        var names = std.StringHashMap([]const u8).init(arena);
+        for (entries.items) |entry| {
+            const existing = try names.getOrPut(entry.name);
+            if (existing.found_existing) {
+                try stderr.print("{s}, {s}: Same output name {s}\n", .{ existing.value_ptr.*, entry.path, entry.name });
+                return error.DuplicateOutputName;
+            }
+            existing.value_ptr.* = entry.path;
+        }
+    }
+
+    const target: d2g.decompile_target = switch (output) {
+        .glsl => d2g.DECOMPILE_TARGET_GLSL,
+        .hlsl => d2g.DECOMPILE_TARGET_HLSL,
+    };
+
+    var out_dir: ?std.fs.Dir = if (batch.out_dir_path) |path|
+        try std.fs.cwd().makeOpenPath(path, .{})
+    else
+        null;
+    defer if (out_dir) |*dir| dir.close();
+
+    // Inputs are read, translated and written one chunk at a time,
+    // so memory use does not grow with the size of the corpus.
+    var chunk_state = std.heap.ArenaAllocator.init(allocator);
+    defer chunk_state.deinit();
+
+    var failed: usize = 0;
+    var start: usize = 0;
+
+    while (start < entries.items.len) {
+        _ = chunk_state.reset(.retain_capacity);
+        const chunk_arena = chunk_state.allocator();
+
+        var inputs = std.ArrayList(d2g.decompile_input).init(chunk_arena);
+        var chunk_bytes: usize = 0;
+
+        while (start + inputs.items.len < entries.items.len and
+            inputs.items.len < max_chunk_entries and chunk_bytes < max_chunk_bytes)
+        {
+            const entry = &entries.items[start + inputs.items.len];
+            const contents = std.fs.cwd().readFileAlloc(chunk_arena, entry.path, max_input_size) catch |err| blk: {
+                entry.read_error = err;
+                break :blk &[_]u8{};
+            };
+            chunk_bytes += contents.len;
+            try inputs.append(.{ .data = contents.ptr, .size = contents.len });
+        }
+
+        const chunk = entries.items[start .. start + inputs.items.len];
+        const results = try chunk_arena.alloc(d2g.decompile_result, chunk.len);
+
+        d2g.decompile_batch(target, inputs.items.ptr, results.ptr, inputs.items.len, batch.threads);
+
+        for (chunk, results) |entry, result| {
+            defer d2g.free_compiled_string(result.output);
+
+            if (entry.read_error) |err| {
+                try stderr.print("{s}: {s}\n", .{ entry.path, @errorName(err) });
+                failed += 1;
+                continue;
+            }
+
+            if (result.status != d2g.DECOMPILE_SUCCESS) {
+                try stderr.print("{s}: {s}\n", .{ entry.path, std.mem.span(d2g.decompile_status_string(result.status)) });
+                failed += 1;
+                continue;
+            }
+
+            if (out_dir) |dir| {
+                const out_name = try std.fmt.allocPrint(chunk_arena, "{s}.{s}", .{ entry.name, @tagName(output) });
+                if (std.fs.path.dirname(out_name)) |sub_path| try dir.makePath(sub_path);
+                try dir.writeFile(.{ .sub_path = out_name, .data = result.output[0..result.output_size] });
+            }
+        }
+
+        start += chunk.len;
+    }
+
+    try stderr.print("{d} translated, {d} failed\n", .{ entries.items.len - failed, failed });
+
+    if (batch.stats) {
+        var stats: d2g.decompile_alloc_stats = undefined;
+        d2g.decompile_get_alloc_stats(&stats);
+        try stderr.print("{d} arena allocations ({d} bytes), {d} heap allocations, at most {d} arena bytes per shader\n", .{
+            stats.arena_allocs,
+            stats.arena_bytes,
+            stats.heap_allocs,
+            stats.max_arena_bytes_allocated,
+        });
+    }
+    if (failed != 0) return error.FailedToCompile;
+}
+
+fn collectDir(arena: std.mem.Allocator, entries: *std.ArrayList(Entry), dir_path: []const u8) !void {
+    var dir = try std.fs.cwd().openDir(dir_path, .{ .iterate = true });
+    defer dir.close();
+
+    var walker = try dir.walk(arena);
+    defer walker.deinit();
+
+    while (try walker.next()) |entry| {
+        if (entry.kind != .file) continue;
+        const name = try arena.dupe(u8, entry.path);
+        try entries.append(.{
+            .path = try std.fs.path.join(arena, &.{ dir_path, name }),
+            .name = name,
+        });
+    }
+}
+
+fn collectList(arena: std.mem.Allocator, entries: *std.ArrayList(Entry), list_path: []const u8) !void {
+    const contents = try std.fs.cwd().readFileAlloc(arena, list_path, 100 * 1024 * 1024);
+
+    var lines = std.mem.tokenizeAny(u8, contents, "\r\n");
+    while (lines.next()) |line| {
+        const path = std.mem.trim(u8, line, " \t");
+        if (path.len == 0) continue;
+
+        const resolved = try std.fs.path.resolve(arena, &.{path});
+        const outside = std.fs.path.isAbsolute(resolved) or std.mem.eql(u8, resolved, "..") or
+            std.mem.startsWith(u8, resolved, ".." ++ std.fs.path.sep_str);
+        try entries.append(.{
+            .path = path,
+            .name = if (outside) std.fs.path.basename(resolved) else resolved,
+        });
+    }
+}
+
 fn usage() noreturn {
     const stderr = std.io.getStdErr().writer();
     stderr.writeAll(
         \\translate [options] file
+        \\translate [options] -d dir | -l list
         \\
-        \\Options: 
-        \\  -g - Output GLSL
-        \\  -h - Output HLSL [Default]
+        \\Options:
+        \\  -g        - Output GLSL
+        \\  -h        - Output HLSL [Default]
+        \\  -d dir    - Translate every file below dir
+        \\  -l list   - Translate every file named in list, one path per line
+        \\  -o outdir - Write batch results to outdir instead of discarding them,
+        \\              keeping paths relative to dir or the working directory
+        \\  -j count  - Number of threads for batch mode [Default: all cores]
+        \\  -s        - Print allocation statistics after batch mode
+        \\  -c dir    - Cache translation results in dir
         \\
     ) catch @panic("failed to print usage");
     std.posix.exit(1);
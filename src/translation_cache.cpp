@@ -0,0 +1,672 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <dxvk/dxvk_hash.h>
+#include <util_error.h>
+#include <util_string.h>
+
+#include "translation_cache.h"
+
+namespace dxvk {
+
+  constexpr uint32_t CacheMagic         = 0x43473244u; // "D2GC"
+  constexpr uint32_t CacheVersion       = 2u;
+  constexpr uint32_t CacheRecordMagic   = 0x52473244u; // "D2GR"
+  constexpr uint32_t CacheIndexCapacity = 1u << 16;
+  constexpr uint32_t CacheMaxSegments   = 32u;
+  constexpr size_t   CacheEntryOffset   = 512u;
+
+
+  struct TranslationCache::IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t entryCount;
+    uint64_t firstSegment;
+    uint64_t activeSegment;
+    uint64_t totalSize;
+    uint64_t segmentSizes[CacheMaxSegments];
+  };
+
+  struct TranslationCache::IndexEntry {
+    TranslationCacheKey key;
+    uint64_t            segment;
+    uint64_t            offset;
+    uint64_t            size;
+  };
+
+
+  /**
+   * \brief Record header
+   *
+   * Precedes each entry's data in a segment file. Lets
+   * readers verify that the index entry they followed
+   * actually points to the data they are looking for,
+   * and that the data is intact.
+   */
+  struct TranslationCacheRecord {
+    uint32_t            magic;
+    uint32_t            reserved;
+    uint64_t            size;
+    uint64_t            checksum;
+    TranslationCacheKey key;
+  };
+
+
+  /**
+   * \brief Computes the checksum of a record's data
+   *
+   * FNV-1a over 64-bit words, with the high half folded
+   * back in after every step so that all bits of a word
+   * affect the result. Meant to catch torn writes and
+   * damaged files, not deliberate tampering.
+   * \param [in] data Record data
+   * \param [in] size Size of the data, in bytes
+   * \returns Checksum
+   */
+  uint64_t computeChecksum(const void* data, size_t size) {
+    constexpr uint64_t Prime = 0x100000001b3ull;
+
+    auto bytes = reinterpret_cast<const unsigned char*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+
+    for ( ; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, bytes + i, sizeof(word));
+
+      hash = (hash ^ word) * Prime;
+      hash ^= hash >> 32;
+    }
+
+    for ( ; i < size; i++)
+      hash = (hash ^ bytes[i]) * Prime;
+
+    return hash;
+  }
+
+
+  /**
+   * \brief Cache file
+   *
+   * Thin wrapper around native file handles that supports
+   * positional reads and writes, memory mapping and
+   * advisory locks shared between processes.
+   */
+  class TranslationCache::File {
+
+  public:
+
+    File(const std::string& path, bool create) {
+#ifdef _WIN32
+      m_handle = ::CreateFileW(str::tows(path.c_str()).c_str(),
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, create ? OPEN_ALWAYS : OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+
+      if (m_handle == INVALID_HANDLE_VALUE)
+        throw DxvkError(str::format("TranslationCache: Failed to open ", path));
+#else
+      m_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+
+      if (m_fd < 0)
+        throw DxvkError(str::format("TranslationCache: Failed to open ", path));
+#endif
+    }
+
+    ~File() {
+#ifdef _WIN32
+      if (m_mapping)
+        ::CloseHandle(m_mapping);
+      ::CloseHandle(m_handle);
+#else
+      ::close(m_fd);
+#endif
+    }
+
+    File             (const File&) = delete;
+    File& operator = (const File&) = delete;
+
+    uint64_t size() const {
+#ifdef _WIN32
+      LARGE_INTEGER size = { };
+      return ::GetFileSizeEx(m_handle, &size) ? uint64_t(size.QuadPart) : 0;
+#else
+      struct stat st = { };
+      return ::fstat(m_fd, &st) == 0 ? uint64_t(st.st_size) : 0;
+#endif
+    }
+
+    bool resize(uint64_t size) {
+#ifdef _WIN32
+      LARGE_INTEGER offset;
+      offset.QuadPart = LONGLONG(size);
+
+      return ::SetFilePointerEx(m_handle, offset, nullptr, FILE_BEGIN)
+          && ::SetEndOfFile(m_handle);
+#else
+      return ::ftruncate(m_fd, off_t(size)) == 0;
+#endif
+    }
+
+    bool read(uint64_t offset, void* data, size_t size) const {
+#ifdef _WIN32
+      OVERLAPPED ov = { };
+      ov.Offset     = DWORD(offset);
+      ov.OffsetHigh = DWORD(offset >> 32);
+
+      DWORD count = 0;
+      return ::ReadFile(m_handle, data, DWORD(size), &count, &ov) && count == size;
+#else
+      auto dst = reinterpret_cast<char*>(data);
+
+      while (size) {
+        ssize_t count = ::pread(m_fd, dst, size, off_t(offset));
+
+        if (count <= 0)
+          return false;
+
+        dst    += count;
+        size   -= count;
+        offset += count;
+      }
+
+      return true;
+#endif
+    }
+
+    bool write(uint64_t offset, const void* data, size_t size) {
+#ifdef _WIN32
+      OVERLAPPED ov = { };
+      ov.Offset     = DWORD(offset);
+      ov.OffsetHigh = DWORD(offset >> 32);
+
+      DWORD count = 0;
+      return ::WriteFile(m_handle, data, DWORD(size), &count, &ov) && count == size;
+#else
+      auto src = reinterpret_cast<const char*>(data);
+
+      while (size) {
+        ssize_t count = ::pwrite(m_fd, src, size, off_t(offset));
+
+        if (count <= 0)
+          return false;
+
+        src    += count;
+        size   -= count;
+        offset += count;
+      }
+
+      return true;
+#endif
+    }
+
+    void* map(size_t size) {
+#ifdef _WIN32
+      m_mapping = ::CreateFileMappingW(m_handle, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+
+      if (!m_mapping)
+        return nullptr;
+
+      return ::MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+      void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+      return ptr != MAP_FAILED ? ptr : nullptr;
+#endif
+    }
+
+    void unmap(void* ptr, size_t size) {
+#ifdef _WIN32
+      ::UnmapViewOfFile(ptr);
+#else
+      ::munmap(ptr, size);
+#endif
+    }
+
+    void lock(bool exclusive) {
+#ifdef _WIN32
+      OVERLAPPED ov = { };
+      ::LockFileEx(m_handle, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0,
+        0, MAXDWORD, MAXDWORD, &ov);
+#else
+      while (::flock(m_fd, exclusive ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR)
+        continue;
+#endif
+    }
+
+    void unlock() {
+#ifdef _WIN32
+      OVERLAPPED ov = { };
+      ::UnlockFileEx(m_handle, 0, MAXDWORD, MAXDWORD, &ov);
+#else
+      ::flock(m_fd, LOCK_UN);
+#endif
+    }
+
+  private:
+
+#ifdef _WIN32
+    HANDLE m_handle  = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int    m_fd      = -1;
+#endif
+
+  };
+
+
+  /**
+   * \brief Scoped file lock
+   */
+  template<typename File>
+  class TranslationCacheLock {
+
+  public:
+
+    TranslationCacheLock(File& file, bool exclusive)
+    : m_file(file) {
+      m_file.lock(exclusive);
+    }
+
+    ~TranslationCacheLock() {
+      m_file.unlock();
+    }
+
+  private:
+
+    File& m_file;
+
+  };
+
+
+  bool TranslationCacheKey::eq(const TranslationCacheKey& other) const {
+    return !std::memcmp(this, &other, sizeof(*this));
+  }
+
+
+  size_t TranslationCacheKey::hash() const {
+    uint64_t words[2];
+    std::memcpy(words, checksum, sizeof(checksum));
+
+    DxvkHashState hash;
+    hash.add(size_t(words[0]));
+    hash.add(size_t(words[1]));
+    hash.add(size_t(inputSize));
+    hash.add(size_t(optionHash));
+    hash.add(uint32_t(kind));
+    return hash;
+  }
+
+
+  TranslationCache::TranslationCache(
+    const std::string&          directory,
+          uint64_t              maxSize)
+  : m_directory (directory),
+    m_maxSize   (maxSize),
+    m_segmentSize(std::max<uint64_t>(maxSize / 16, 1ull << 20)) {
+    std::error_code ec;
+    std::filesystem::create_directories(str::topath(directory.c_str()), ec);
+
+    m_indexFile = std::make_unique<File>(m_directory + "/index.bin", true);
+    m_indexSize = CacheEntryOffset + CacheIndexCapacity * sizeof(IndexEntry);
+
+    TranslationCacheLock<File> lock(*m_indexFile, true);
+    this->initIndex();
+
+    m_indexMap = m_indexFile->map(m_indexSize);
+
+    if (!m_indexMap)
+      throw DxvkError("TranslationCache: Failed to map index file");
+
+    this->recountSize();
+  }
+
+
+  TranslationCache::~TranslationCache() {
+    m_indexFile->unmap(m_indexMap, m_indexSize);
+  }
+
+
+  bool TranslationCache::lookup(
+    const TranslationCacheKey&  key,
+          std::vector<char>&    data) {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+    bool promote = false;
+
+    { TranslationCacheLock<File> fileLock(*m_indexFile, false);
+
+      if (!isIndexValid())
+        return false;
+
+      this->closeStaleSegments();
+
+      const IndexEntry* entry = this->findEntry(key);
+
+      if (!entry->segment || !this->readEntry(entry, data))
+        return false;
+
+      // Copy entries from the older half of the segments
+      // forward, so that they survive eviction for longer.
+      const IndexHeader* h = this->header();
+      promote = entry->segment < h->firstSegment + (h->activeSegment - h->firstSegment + 1) / 2;
+    }
+
+    if (promote) {
+      TranslationCacheLock<File> fileLock(*m_indexFile, true);
+
+      if (isIndexValid())
+        this->writeEntry(key, data.data(), data.size());
+    }
+
+    return true;
+  }
+
+
+  void TranslationCache::store(
+    const TranslationCacheKey&  key,
+    const void*                 data,
+          size_t                size) {
+    std::lock_guard<dxvk::mutex> lock(m_mutex);
+    TranslationCacheLock<File> fileLock(*m_indexFile, true);
+
+    if (isIndexValid())
+      this->writeEntry(key, data, size);
+  }
+
+
+  TranslationCache::IndexHeader* TranslationCache::header() const {
+    return reinterpret_cast<IndexHeader*>(m_indexMap);
+  }
+
+
+  TranslationCache::IndexEntry* TranslationCache::entries() const {
+    static_assert(sizeof(IndexHeader) <= CacheEntryOffset);
+
+    return reinterpret_cast<IndexEntry*>(
+      reinterpret_cast<char*>(m_indexMap) + CacheEntryOffset);
+  }
+
+
+  bool TranslationCache::isHeaderValid(const IndexHeader& h) {
+    // Sizes are not checked since they can be recomputed,
+    // but a broken segment range cannot be repaired.
+    return h.magic    == CacheMagic
+        && h.version  == CacheVersion
+        && h.capacity == CacheIndexCapacity
+        && h.firstSegment  >= 1
+        && h.firstSegment  <= h.activeSegment
+        && h.activeSegment -  h.firstSegment < CacheMaxSegments;
+  }
+
+
+  void TranslationCache::initIndex() {
+    IndexHeader h = { };
+
+    if (m_indexFile->size() == m_indexSize
+     && m_indexFile->read(0, &h, sizeof(h))
+     && isHeaderValid(h))
+      return;
+
+    // The index is missing, incompatible or damaged. Start
+    // from scratch and remove any data segments it owned.
+    h = IndexHeader();
+    h.magic         = CacheMagic;
+    h.version       = CacheVersion;
+    h.capacity      = CacheIndexCapacity;
+    h.firstSegment  = 1;
+    h.activeSegment = 1;
+
+    if (!m_indexFile->resize(0)
+     || !m_indexFile->resize(m_indexSize)
+     || !m_indexFile->write(0, &h, sizeof(h)))
+      throw DxvkError("TranslationCache: Failed to initialize index file");
+
+    std::error_code ec;
+
+    for (const auto& file : std::filesystem::directory_iterator(str::topath(m_directory.c_str()), ec)) {
+      auto name = file.path().filename().string();
+
+      if (name.rfind("data-", 0) == 0)
+        std::filesystem::remove(file.path(), ec);
+    }
+  }
+
+
+  bool TranslationCache::isIndexValid() const {
+    return isHeaderValid(*this->header());
+  }
+
+
+  void TranslationCache::recountSize() {
+    IndexHeader* h = this->header();
+    uint64_t totalSize = 0;
+
+    for (uint64_t s = h->firstSegment; s <= h->activeSegment; s++) {
+      uint64_t& size = h->segmentSizes[s % CacheMaxSegments];
+      size = std::min(size, m_maxSize);
+      totalSize += size;
+    }
+
+    h->totalSize = totalSize;
+  }
+
+
+  TranslationCache::IndexEntry* TranslationCache::findEntry(
+    const TranslationCacheKey&  key) const {
+    // Linear probing. Entries are only ever removed by
+    // rebuilding the table, so an empty slot always
+    // terminates the search.
+    IndexEntry* table = this->entries();
+
+    uint32_t mask = CacheIndexCapacity - 1;
+    uint32_t slot = uint32_t(key.hash()) & mask;
+
+    while (table[slot].segment && !table[slot].key.eq(key))
+      slot = (slot + 1) & mask;
+
+    return &table[slot];
+  }
+
+
+  bool TranslationCache::readEntry(
+    const IndexEntry*           entry,
+          std::vector<char>&    data) {
+    File* file = this->getSegmentFile(entry->segment);
+
+    if (!file)
+      return false;
+
+    TranslationCacheRecord record = { };
+
+    if (!file->read(entry->offset, &record, sizeof(record))
+     || record.magic != CacheRecordMagic
+     || record.size  != entry->size
+     || record.size  >  m_maxSize
+     || !record.key.eq(entry->key))
+      return false;
+
+    data.resize(record.size);
+
+    return file->read(entry->offset + sizeof(record), data.data(), data.size())
+        && computeChecksum(data.data(), data.size()) == record.checksum;
+  }
+
+
+  bool TranslationCache::writeEntry(
+    const TranslationCacheKey&  key,
+    const void*                 data,
+          size_t                size) {
+    TranslationCacheRecord record = { };
+    record.magic = CacheRecordMagic;
+    record.size     = size;
+    record.checksum = computeChecksum(data, size);
+    record.key      = key;
+
+    uint64_t recordSize = sizeof(record) + size;
+
+    if (!this->allocateSpace(recordSize))
+      return false;
+
+    IndexHeader* h = this->header();
+    File* file = this->getSegmentFile(h->activeSegment);
+
+    if (!file)
+      return false;
+
+    uint64_t& segmentSize = h->segmentSizes[h->activeSegment % CacheMaxSegments];
+
+    if (!file->write(segmentSize, &record, sizeof(record))
+     || !file->write(segmentSize + sizeof(record), data, size))
+      return false;
+
+    // Only publish the entry once the data is written
+    IndexEntry* entry = this->findEntry(key);
+
+    if (!entry->segment)
+      h->entryCount += 1;
+
+    entry->key      = key;
+    entry->segment  = h->activeSegment;
+    entry->offset   = segmentSize;
+    entry->size     = size;
+
+    segmentSize  += recordSize;
+    h->totalSize += recordSize;
+    return true;
+  }
+
+
+  bool TranslationCache::allocateSpace(
+          uint64_t              recordSize) {
+    if (recordSize > m_maxSize)
+      return false;
+
+    IndexHeader* h = this->header();
+
+    // A process that died between updating a segment size and
+    // the total leaves them out of sync, so never trust the total
+    this->recountSize();
+
+    if (h->segmentSizes[h->activeSegment % CacheMaxSegments]
+      && h->segmentSizes[h->activeSegment % CacheMaxSegments] + recordSize > m_segmentSize)
+      this->rotateSegment();
+
+    while (h->totalSize + recordSize > m_maxSize
+        || h->entryCount + 1 > (CacheIndexCapacity / 4) * 3) {
+      // Nothing is left to evict, so the counts are inconsistent
+      // beyond repair. Give up rather than spin under the lock.
+      if (h->firstSegment == h->activeSegment) {
+        if (!h->segmentSizes[h->activeSegment % CacheMaxSegments])
+          return false;
+
+        this->rotateSegment();
+      }
+
+      this->evictSegment();
+    }
+
+    return true;
+  }
+
+
+  void TranslationCache::rotateSegment() {
+    IndexHeader* h = this->header();
+
+    if (h->activeSegment - h->firstSegment + 1 >= CacheMaxSegments)
+      this->evictSegment();
+
+    h->activeSegment += 1;
+    h->segmentSizes[h->activeSegment % CacheMaxSegments] = 0;
+  }
+
+
+  void TranslationCache::evictSegment() {
+    IndexHeader* h = this->header();
+    IndexEntry* table = this->entries();
+
+    uint64_t segment = h->firstSegment;
+
+    h->totalSize -= std::min(h->totalSize, h->segmentSizes[segment % CacheMaxSegments]);
+    h->segmentSizes[segment % CacheMaxSegments] = 0;
+    h->firstSegment += 1;
+
+    // Rebuild the table without the evicted entries
+    std::vector<IndexEntry> live;
+    live.reserve(h->entryCount);
+
+    for (uint32_t i = 0; i < CacheIndexCapacity; i++) {
+      if (table[i].segment && table[i].segment != segment)
+        live.push_back(table[i]);
+    }
+
+    std::memset(table, 0, CacheIndexCapacity * sizeof(IndexEntry));
+    h->entryCount = live.size();
+
+    for (const auto& entry : live)
+      *this->findEntry(entry.key) = entry;
+
+    auto file = m_segmentFiles.find(segment);
+
+    if (file != m_segmentFiles.end())
+      m_segmentFiles.erase(file);
+
+    std::error_code ec;
+    std::filesystem::remove(str::topath(getSegmentPath(segment).c_str()), ec);
+  }
+
+
+  TranslationCache::File* TranslationCache::getSegmentFile(
+          uint64_t              segment) {
+    auto entry = m_segmentFiles.find(segment);
+
+    if (entry != m_segmentFiles.end())
+      return entry->second.get();
+
+    try {
+      // Only the active segment may be created, any
+      // other segment must already exist on disk.
+      bool create = segment == this->header()->activeSegment;
+
+      auto file = std::make_unique<File>(getSegmentPath(segment), create);
+      return m_segmentFiles.emplace(segment, std::move(file)).first->second.get();
+    } catch (const DxvkError&) {
+      return nullptr;
+    }
+  }
+
+
+  void TranslationCache::closeStaleSegments() {
+    uint64_t firstSegment = this->header()->firstSegment;
+
+    for (auto i = m_segmentFiles.begin(); i != m_segmentFiles.end(); ) {
+      if (i->first < firstSegment)
+        i = m_segmentFiles.erase(i);
+      else
+        i++;
+    }
+  }
+
+
+  std::string TranslationCache::getSegmentPath(
+          uint64_t              segment) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/data-%016llx.bin",
+      static_cast<unsigned long long>(segment));
+    return m_directory + name;
+  }
+
+}
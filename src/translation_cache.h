@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <thread.h>
+
+namespace dxvk {
+
+  /**
+   * \brief Translation cache entry kind
+   */
+  enum class TranslationCacheKind : uint32_t {
+    Spirv = 1,
+    Glsl  = 2,
+    Hlsl  = 3,
+  };
+
+
+  /**
+   * \brief Translation cache key
+   *
+   * Identifies a translated shader by the checksum and size
+   * of the DXBC blob, a hash of all options that affect the
+   * output, and the kind of data stored in the entry.
+   */
+  struct TranslationCacheKey {
+    uint8_t               checksum[16];
+    uint64_t              inputSize;
+    uint64_t              optionHash;
+    TranslationCacheKind  kind;
+    uint32_t              reserved;
+
+    bool eq(const TranslationCacheKey& other) const;
+
+    size_t hash() const;
+  };
+
+  static_assert(sizeof(TranslationCacheKey) == 40);
+
+
+  /**
+   * \brief Persistent translation cache
+   *
+   * Stores translation results in a directory on disk. The
+   * directory contains a memory-mapped index file, which is
+   * a fixed-size hash table, and a number of append-only
+   * data segments. Only the most recent segment is written
+   * to. Once the cache exceeds its size limit, the oldest
+   * segment is deleted as a whole. Entries that are looked
+   * up while in the older half of all segments get copied
+   * to the newest segment, so that eviction approximates
+   * LRU order without ever rewriting data in place.
+   *
+   * The index is protected by a file lock, so multiple
+   * processes can share the same cache directory.
+   */
+  class TranslationCache {
+
+  public:
+
+    /**
+     * \brief Opens or creates a cache
+     *
+     * \param [in] directory Cache directory, created if needed
+     * \param [in] maxSize Maximum size of all data segments, in bytes
+     * \throws DxvkError if the cache cannot be opened
+     */
+    TranslationCache(
+      const std::string&          directory,
+            uint64_t              maxSize);
+
+    ~TranslationCache();
+
+    TranslationCache             (const TranslationCache&) = delete;
+    TranslationCache& operator = (const TranslationCache&) = delete;
+
+    /**
+     * \brief Looks up an entry
+     *
+     * \param [in] key Entry key
+     * \param [out] data Entry data
+     * \returns \c true if the entry was found
+     */
+    bool lookup(
+      const TranslationCacheKey&  key,
+            std::vector<char>&    data);
+
+    /**
+     * \brief Stores an entry
+     *
+     * Replaces any existing entry with the same key.
+     * Failures are not fatal, the entry is simply
+     * not going to be found in future lookups.
+     * \param [in] key Entry key
+     * \param [in] data Entry data
+     * \param [in] size Size of the data, in bytes
+     */
+    void store(
+      const TranslationCacheKey&  key,
+      const void*                 data,
+            size_t                size);
+
+  private:
+
+    class File;
+
+    struct IndexHeader;
+    struct IndexEntry;
+
+    std::string   m_directory;
+    uint64_t      m_maxSize;
+    uint64_t      m_segmentSize;
+
+    dxvk::mutex   m_mutex;
+
+    std::unique_ptr<File> m_indexFile;
+    void*         m_indexMap    = nullptr;
+    size_t        m_indexSize   = 0;
+
+    std::unordered_map<uint64_t, std::unique_ptr<File>> m_segmentFiles;
+
+    IndexHeader* header() const;
+
+    IndexEntry* entries() const;
+
+    void initIndex();
+
+    bool isIndexValid() const;
+
+    static bool isHeaderValid(
+      const IndexHeader&          h);
+
+    void recountSize();
+
+    IndexEntry* findEntry(
+      const TranslationCacheKey&  key) const;
+
+    bool readEntry(
+      const IndexEntry*           entry,
+            std::vector<char>&    data);
+
+    bool writeEntry(
+      const TranslationCacheKey&  key,
+      const void*                 data,
+            size_t                size);
+
+    bool allocateSpace(
+            uint64_t              recordSize);
+
+    void rotateSegment();
+
+    void evictSegment();
+
+    File* getSegmentFile(
+            uint64_t              segment);
+
+    void closeStaleSegments();
+
+    std::string getSegmentPath(
+            uint64_t              segment) const;
+
+  };
+
+}